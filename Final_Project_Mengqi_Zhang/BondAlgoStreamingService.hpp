@@ -5,31 +5,121 @@
 //  Created by Mengqi Zhang on 12/21/16.
 //  Copyright © 2016 Mengqi Zhang. All rights reserved.
 //
+//  Every tick streams one two-way price per configured tier. A tier widens each side
+//  beyond half the bid/offer spread and alternates between two visible and hidden sizes
+//  on successive ticks of a product. The mid is skewed against the aggregate position.
+//  Streams are repriced in place in one slot per (product, tier), created on the
+//  product's first tick, and published by reference. Slots are only touched by the
+//  pricing thread; positions may arrive on another thread and are kept apart, under a lock.
+//
 
 #ifndef BondAlgoStreamingService_h
 #define BondAlgoStreamingService_h
 
+#include <unordered_map>
+#include <mutex>
 #include "streamingservice.hpp"
 #include "pricingservice.hpp"
+#include "positionservice.hpp"
+
+/**
+ * One tier of streamed size.
+ * Sizes alternate between entry 0 and entry 1 on successive ticks of a product.
+ */
+struct StreamingTier
+{
+    double extraSpread;//widening of each side beyond half the bid/offer spread
+    long visibleQuantity[2];
+    long hiddenQuantity[2];
+};
+
+// Default tiers: a single tier of 10,000,000 visible at the bid/offer
+const StreamingTier DEFAULT_STREAMING_TIER = { 0, {10000000, 10000000}, {0, 0} };
 
 class BondAlgoStreamingService: public Service<string, Price<Bond>>
 {
     BondStreamingService& streaming_service;
     vector<ServiceListener<Price<Bond>>*> listener_list;
+    vector<StreamingTier> tiers;
+    double skew;//mid move per 1,000,000 of aggregate position, against the position
+    unordered_map<string, size_t> product_index;//map from cusip to its product slot
+    vector<PriceStream<Bond>> streams;//stream of each (product slot, tier), tiers.size() entries per product
+    vector<long> tick_count;//ticks of each product slot
+    mutex position_lock;//guards position, which the position thread writes
+    unordered_map<string, long> position;//map from cusip to its aggregate position
+
+    size_t Product(const Bond& bond);
 public:
-    BondAlgoStreamingService(BondStreamingService& input): streaming_service(input){}
+    BondAlgoStreamingService(BondStreamingService& input, const vector<StreamingTier>& _tiers = vector<StreamingTier>(1, DEFAULT_STREAMING_TIER), double _skew = 0);
     Price<Bond>& GetData(string id) override {exit(-1);};
     void OnMessage(Price<Bond>& price) override;
+    // Take the new aggregate position of a product for the skew; safe from another thread
+    void AddPosition(Position<Bond>& position);
+    // Get the number of tiers streamed per product
+    size_t GetTierCount() const;
     void AddListener(ServiceListener<Price<Bond>>* listener) override;
     const vector<ServiceListener<Price<Bond>>*>& GetListeners() const override;
 };
 
+BondAlgoStreamingService::BondAlgoStreamingService(BondStreamingService& input, const vector<StreamingTier>& _tiers, double _skew) :
+streaming_service(input), tiers(_tiers), skew(_skew)
+{
+    if(tiers.empty())
+    {
+        cout << "No streaming tiers!" << endl;
+        exit(-1);
+    }
+}
+
+size_t BondAlgoStreamingService::Product(const Bond& bond)
+{
+    auto iter = product_index.find(bond.GetProductId());
+    if(iter != product_index.end()) return iter->second;
+    size_t slot = tick_count.size();
+    product_index[bond.GetProductId()] = slot;
+    for(size_t t = 0; t < tiers.size(); ++t)
+    {
+        PriceStreamOrder bid_order(0, 0, 0, BID);
+        PriceStreamOrder offer_order(0, 0, 0, OFFER);
+        streams.push_back(PriceStream<Bond>(bond, bid_order, offer_order, int(t)));
+    }
+    tick_count.push_back(0);
+    return slot;
+}
+
 void BondAlgoStreamingService::OnMessage(Price<Bond>& price)
 {
-    PriceStreamOrder bid_order(double(price.GetMid() - price.GetBidOfferSpread()/2), 10000000, 0, BID);
-    PriceStreamOrder offer_order(double(price.GetMid()+price.GetBidOfferSpread()/2), 10000000, 0, OFFER);
-    PriceStream<Bond> new_price_stream(price.GetProduct(), bid_order, offer_order);
-    streaming_service.PublishPrice(new_price_stream);
+    size_t slot = Product(price.GetProduct());
+    int parity = int(tick_count[slot]++ & 1);
+    long aggregate = 0;
+    if(skew != 0)
+    {
+        lock_guard<mutex> lock(position_lock);
+        auto iter = position.find(price.GetProduct().GetProductId());
+        if(iter != position.end()) aggregate = iter->second;
+    }
+    double mid = price.GetMid() - skew * aggregate / 1000000;
+    double half_spread = price.GetBidOfferSpread()/2;
+    PriceStream<Bond>* stream = &streams[slot * tiers.size()];
+    for(size_t t = 0; t < tiers.size(); ++t)
+    {
+        const StreamingTier& tier = tiers[t];
+        stream[t].Update(mid - half_spread - tier.extraSpread, mid + half_spread + tier.extraSpread,
+                         tier.visibleQuantity[parity], tier.hiddenQuantity[parity]);
+        streaming_service.PublishPrice(stream[t]);
+    }
+}
+
+//called from the position thread, so no stream slot is created here
+void BondAlgoStreamingService::AddPosition(Position<Bond>& _position)
+{
+    lock_guard<mutex> lock(position_lock);
+    position[_position.GetProduct().GetProductId()] = _position.GetAggregatePosition();
+}
+
+size_t BondAlgoStreamingService::GetTierCount() const
+{
+    return tiers.size();
 }
 
 void BondAlgoStreamingService::AddListener(ServiceListener<Price<Bond>>* listener)
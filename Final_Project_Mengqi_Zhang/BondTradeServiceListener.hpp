@@ -3,7 +3,9 @@
 //  Final_Project_Mengqi_Zhang
 //
 //  A listener class inherited from ServiceListener<Trade<Bond>>
-//  that linked BondTradeBookingService to BondPositionService in ProcessAdd Method
+//  that linked BondTradeBookingService to BondPositionService in ProcessAdd Method.
+//  Cancellations arrive as ProcessRemove; amendments arrive as one ProcessAmend and reach
+//  the position service as a single change.
 //
 //  Created by Mengqi Zhang on 12/17/16.
 //  Copyright © 2016 Mengqi Zhang. All rights reserved.
@@ -14,15 +16,16 @@
 
 #include "positionservice.hpp"
 
-class BondTradeServiceListener: public ServiceListener<Trade<Bond>>
+class BondTradeServiceListener: public ServiceListener<Trade<Bond>>, public TradeAmendListener<Bond>
 {
 private:
     BondPositionService &position_service;
 public:
     BondTradeServiceListener(BondPositionService& input);
     void ProcessAdd(Trade<Bond> & trade);
-    void ProcessRemove(Trade<Bond> & trade){};
-    void ProcessUpdate(Trade<Bond> & trade){};
+    void ProcessRemove(Trade<Bond> & trade);
+    void ProcessUpdate(Trade<Bond> & trade);
+    void ProcessAmend(Trade<Bond> & previous, Trade<Bond> & amended);
 };
 
 BondTradeServiceListener::BondTradeServiceListener(BondPositionService & input):position_service(input){}
@@ -30,4 +33,19 @@ BondTradeServiceListener::BondTradeServiceListener(BondPositionService & input):
 void BondTradeServiceListener::ProcessAdd(Trade<Bond> & trade){
     position_service.AddTrade(trade);
 }
+
+//reverse a cancelled trade
+void BondTradeServiceListener::ProcessRemove(Trade<Bond> & trade){
+    position_service.RemoveTrade(trade);
+}
+
+//a trade updated without its previous version is applied as a new trade
+void BondTradeServiceListener::ProcessUpdate(Trade<Bond> & trade){
+    position_service.AddTrade(trade);
+}
+
+//swap the previous version of an amended trade for the new one
+void BondTradeServiceListener::ProcessAmend(Trade<Bond> & previous, Trade<Bond> & amended){
+    position_service.AmendTrade(previous, amended);
+}
 #endif /* BondTradeServiceListener_h */
@@ -0,0 +1,31 @@
+//
+//  CurveRiskListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<YieldCurve>
+//  that passes every fitted curve from BondCurveService to BondRiskService,
+//  which measures the yield of each product against it.
+//
+
+#ifndef CurveRiskListener_h
+#define CurveRiskListener_h
+
+#include "riskservice.hpp"
+#include "curveservice.hpp"
+
+class CurveRiskListener : public ServiceListener<YieldCurve>
+{
+    BondRiskService& risk_service;
+public:
+    CurveRiskListener(BondRiskService& input): risk_service(input){}
+    void ProcessAdd(YieldCurve& curve);
+    void ProcessRemove(YieldCurve& data){}
+    void ProcessUpdate(YieldCurve& data){}
+};
+
+void CurveRiskListener::ProcessAdd(YieldCurve& curve)
+{
+    risk_service.UpdateCurve(curve);
+}
+
+#endif /* CurveRiskListener_h */
@@ -0,0 +1,29 @@
+//
+//  PnLListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<PnL<Bond>>
+//  that passes every P&L change from BondPnLService to BondHistoricalPnLDataService.
+//
+
+#ifndef PnLListener_h
+#define PnLListener_h
+
+#include "historicaldataservice.hpp"
+
+class PnLListener : public ServiceListener<PnL<Bond>>
+{
+    BondHistoricalPnLDataService& historical_pnl;
+public:
+    PnLListener(BondHistoricalPnLDataService& input): historical_pnl(input){}
+    void ProcessAdd(PnL<Bond>& data);
+    void ProcessRemove(PnL<Bond>& data){}
+    void ProcessUpdate(PnL<Bond>& data){}
+};
+
+void PnLListener::ProcessAdd(PnL<Bond>& data)
+{
+    historical_pnl.OnMessage(data);
+}
+
+#endif /* PnLListener_h */
@@ -0,0 +1,30 @@
+//
+//  PositionPnLListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<Position<Bond>>
+//  that passes every position change from BondPositionService to BondPnLService,
+//  which fills the books that moved at the current mark.
+//
+
+#ifndef PositionPnLListener_h
+#define PositionPnLListener_h
+
+#include "pnlservice.hpp"
+
+class PositionPnLListener : public ServiceListener<Position<Bond>>
+{
+    BondPnLService& pnl_service;
+public:
+    PositionPnLListener(BondPnLService& input): pnl_service(input){}
+    void ProcessAdd(Position<Bond>& data);
+    void ProcessRemove(Position<Bond>& data){}
+    void ProcessUpdate(Position<Bond>& data){}
+};
+
+void PositionPnLListener::ProcessAdd(Position<Bond>& data)
+{
+    pnl_service.AddPosition(data);
+}
+
+#endif /* PositionPnLListener_h */
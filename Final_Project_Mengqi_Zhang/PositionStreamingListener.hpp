@@ -0,0 +1,30 @@
+//
+//  PositionStreamingListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<Position<Bond>>
+//  that passes every new position from BondPositionService to BondAlgoStreamingService,
+//  which skews the streamed prices of the product against it.
+//
+
+#ifndef PositionStreamingListener_h
+#define PositionStreamingListener_h
+
+#include "BondAlgoStreamingService.hpp"
+
+class PositionStreamingListener : public ServiceListener<Position<Bond>>
+{
+    BondAlgoStreamingService& algo_streaming_service;
+public:
+    PositionStreamingListener(BondAlgoStreamingService& input): algo_streaming_service(input){}
+    void ProcessAdd(Position<Bond>& data);
+    void ProcessRemove(Position<Bond>& data){}
+    void ProcessUpdate(Position<Bond>& data){}
+};
+
+void PositionStreamingListener::ProcessAdd(Position<Bond>& data)
+{
+    algo_streaming_service.AddPosition(data);
+}
+
+#endif /* PositionStreamingListener_h */
@@ -0,0 +1,30 @@
+//
+//  PositionVaRListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<Position<Bond>>
+//  that passes every position change from BondPositionService to BondVaRService,
+//  which re-weights the P&L scenarios of the product.
+//
+
+#ifndef PositionVaRListener_h
+#define PositionVaRListener_h
+
+#include "varservice.hpp"
+
+class PositionVaRListener : public ServiceListener<Position<Bond>>
+{
+    BondVaRService& var_service;
+public:
+    PositionVaRListener(BondVaRService& input): var_service(input){}
+    void ProcessAdd(Position<Bond>& position);
+    void ProcessRemove(Position<Bond>& position){}
+    void ProcessUpdate(Position<Bond>& position){}
+};
+
+void PositionVaRListener::ProcessAdd(Position<Bond>& position)
+{
+    var_service.AddPosition(position);
+}
+
+#endif /* PositionVaRListener_h */
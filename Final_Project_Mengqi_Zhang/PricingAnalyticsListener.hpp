@@ -0,0 +1,32 @@
+//
+//  PricingAnalyticsListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<Price<Bond>>
+//  that solves the yield, PV01 and key rates of every new mid once on BondAnalytics.
+//  It is added to BondPricingService before the risk, curve and spread listeners,
+//  which only read what it solved.
+//
+
+#ifndef PricingAnalyticsListener_h
+#define PricingAnalyticsListener_h
+
+#include "pricingservice.hpp"
+#include "bondanalytics.hpp"
+
+class PricingAnalyticsListener : public ServiceListener<Price<Bond>>
+{
+    BondAnalytics& analytics;
+public:
+    PricingAnalyticsListener(BondAnalytics& input): analytics(input){}
+    void ProcessAdd(Price<Bond>& price);
+    void ProcessRemove(Price<Bond>& data){}
+    void ProcessUpdate(Price<Bond>& data){}
+};
+
+void PricingAnalyticsListener::ProcessAdd(Price<Bond>& price)
+{
+    analytics.SetPrice(analytics.AddBond(price.GetProduct()), price.GetMid());
+}
+
+#endif /* PricingAnalyticsListener_h */
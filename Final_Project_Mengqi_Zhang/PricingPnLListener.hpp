@@ -0,0 +1,30 @@
+//
+//  PricingPnLListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<Price<Bond>>
+//  that passes every new mid from BondPricingService to BondPnLService,
+//  which marks the P&L of the product to it.
+//
+
+#ifndef PricingPnLListener_h
+#define PricingPnLListener_h
+
+#include "pnlservice.hpp"
+
+class PricingPnLListener : public ServiceListener<Price<Bond>>
+{
+    BondPnLService& pnl_service;
+public:
+    PricingPnLListener(BondPnLService& input): pnl_service(input){}
+    void ProcessAdd(Price<Bond>& data);
+    void ProcessRemove(Price<Bond>& data){}
+    void ProcessUpdate(Price<Bond>& data){}
+};
+
+void PricingPnLListener::ProcessAdd(Price<Bond>& data)
+{
+    pnl_service.AddPrice(data);
+}
+
+#endif /* PricingPnLListener_h */
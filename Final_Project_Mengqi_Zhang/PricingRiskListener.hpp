@@ -0,0 +1,30 @@
+//
+//  PricingRiskListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<Price<Bond>>
+//  that passes every new mid from BondPricingService to BondRiskService,
+//  which re-risks the position of the product at its newly solved PV01.
+//
+
+#ifndef PricingRiskListener_h
+#define PricingRiskListener_h
+
+#include "riskservice.hpp"
+
+class PricingRiskListener : public ServiceListener<Price<Bond>>
+{
+    BondRiskService& risk_service;
+public:
+    PricingRiskListener(BondRiskService& input): risk_service(input){}
+    void ProcessAdd(Price<Bond>& price);
+    void ProcessRemove(Price<Bond>& data){}
+    void ProcessUpdate(Price<Bond>& data){}
+};
+
+void PricingRiskListener::ProcessAdd(Price<Bond>& price)
+{
+    risk_service.UpdatePrice(price);
+}
+
+#endif /* PricingRiskListener_h */
@@ -0,0 +1,30 @@
+//
+//  PricingSpreadListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<Price<Bond>>
+//  that passes every new mid from BondPricingService to BondSpreadService,
+//  which re-sums the spreads the product is a leg of.
+//
+
+#ifndef PricingSpreadListener_h
+#define PricingSpreadListener_h
+
+#include "spreadservice.hpp"
+
+class PricingSpreadListener : public ServiceListener<Price<Bond>>
+{
+    BondSpreadService& spread_service;
+public:
+    PricingSpreadListener(BondSpreadService& input): spread_service(input){}
+    void ProcessAdd(Price<Bond>& data);
+    void ProcessRemove(Price<Bond>& data){}
+    void ProcessUpdate(Price<Bond>& data){}
+};
+
+void PricingSpreadListener::ProcessAdd(Price<Bond>& data)
+{
+    spread_service.AddPrice(data);
+}
+
+#endif /* PricingSpreadListener_h */
@@ -0,0 +1,30 @@
+//
+//  PricingVaRListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<Price<Bond>>
+//  that passes every new mid from BondPricingService to BondVaRService,
+//  which adds the price move to the history of the product.
+//
+
+#ifndef PricingVaRListener_h
+#define PricingVaRListener_h
+
+#include "varservice.hpp"
+
+class PricingVaRListener : public ServiceListener<Price<Bond>>
+{
+    BondVaRService& var_service;
+public:
+    PricingVaRListener(BondVaRService& input): var_service(input){}
+    void ProcessAdd(Price<Bond>& price);
+    void ProcessRemove(Price<Bond>& data){}
+    void ProcessUpdate(Price<Bond>& data){}
+};
+
+void PricingVaRListener::ProcessAdd(Price<Bond>& price)
+{
+    var_service.AddPrice(price);
+}
+
+#endif /* PricingVaRListener_h */
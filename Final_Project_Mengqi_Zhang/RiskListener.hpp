@@ -10,20 +10,20 @@
 #define RiskListener_h
 #include "historicaldataservice.hpp"
 
-class RiskListener: public ServiceListener<vector<PV01<Bond>>>
+class RiskListener: public ServiceListener<RiskUpdate<Bond>>
 {
     BondHistoricalRiskDataService& historical_risk;
 public:
     RiskListener(BondHistoricalRiskDataService& input): historical_risk(input){}
     
-    void ProcessAdd(vector<PV01<Bond>> &v);
-    void ProcessRemove(vector<PV01<Bond>> &v){}
-    void ProcessUpdate(vector<PV01<Bond>> &v){}
+    void ProcessAdd(RiskUpdate<Bond> &update);
+    void ProcessRemove(RiskUpdate<Bond> &update){}
+    void ProcessUpdate(RiskUpdate<Bond> &update){}
 };
 
-void RiskListener::ProcessAdd(vector<PV01<Bond>> &v)
+void RiskListener::ProcessAdd(RiskUpdate<Bond> &update)
 {
-    historical_risk.OnMessage(v);
+    historical_risk.OnMessage(update);
 }
 
 #endif /* RiskListener_h */
@@ -0,0 +1,29 @@
+//
+//  SpreadListener.hpp
+//  Final_Project_Mengqi_Zhang
+//
+//  A listener class inherited from ServiceListener<Spread<Bond>>
+//  that passes every spread change from BondSpreadService to BondHistoricalSpreadDataService.
+//
+
+#ifndef SpreadListener_h
+#define SpreadListener_h
+
+#include "historicaldataservice.hpp"
+
+class SpreadListener : public ServiceListener<Spread<Bond>>
+{
+    BondHistoricalSpreadDataService& historical_spread;
+public:
+    SpreadListener(BondHistoricalSpreadDataService& input): historical_spread(input){}
+    void ProcessAdd(Spread<Bond>& data);
+    void ProcessRemove(Spread<Bond>& data){}
+    void ProcessUpdate(Spread<Bond>& data){}
+};
+
+void SpreadListener::ProcessAdd(Spread<Bond>& data)
+{
+    historical_spread.OnMessage(data);
+}
+
+#endif /* SpreadListener_h */
@@ -0,0 +1,120 @@
+/**
+ * benchmarks.hpp
+ * Benchmarks run from main with a flag instead of the daily flow:
+ *
+ *   --bench-format [rows]            rows/sec of the historical row formatter against the
+ *                                    setw iostream formatting it replaced
+ *   --bench-trades [events] [amend%] events/sec of booking, position and risk with a share
+ *                                    of amendments of earlier trades
+ *
+ * Build with optimization, for example g++ -std=gnu++11 -O2 -pthread main.cpp, and run in
+ * the directory of the input files. Scratch output goes to bench_*.txt there.
+ */
+#ifndef BENCHMARKS_HPP
+#define BENCHMARKS_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "BondTradeServiceListener.hpp"
+#include "BondPositionServiceListener.hpp"
+#include "historicaldataservice.hpp"
+
+using namespace std;
+
+// Default sizes of the benchmarks
+const long BENCH_FORMAT_ROWS = 2000000;
+const long BENCH_TRADE_EVENTS = 1000000;
+const int BENCH_AMEND_PERCENT = 5;
+
+// Rows/sec of executions.txt rows, through the old setw path and the schema row writer
+void RunFormatterBenchmark(long rows = BENCH_FORMAT_ROWS)
+{
+    ExecutionOrder<Bond> order(Bond("912828M72"), OFFER, "T12345", MARKET, 99.515625, 10000000, 0, "NULL", false);
+
+    //the iostream formatting historicaldataservice.hpp used before RecordBuffer
+    {
+        ofstream f("bench_iostream.txt");
+        auto start = chrono::steady_clock::now();
+        for (long i = 0; i < rows; ++i)
+        {
+            f << setw(5) << to_string(i + 1) << setw(15) << order.GetProduct().GetProductId()
+              << setw(10) << string(PRICING_SIDE_NAMES[order.GetSide()]) << setw(10) << order.GetOrderId()
+              << setw(13) << string(ORDER_TYPE_NAMES[order.GetOrderType()]) << setw(10) << FractionalBondPrice(order.GetPrice())
+              << setw(18) << order.GetVisibleQuantity() << setw(18) << order.GetHiddenQuantity()
+              << setw(18) << order.GetParentOrderId() << setw(15) << string(BOOL_NAMES[order.IsChildOrder()]) << endl;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "iostream setw:     " << rows / seconds << " rows/s" << endl;
+    }
+
+    //the path HistoricalDataConnector takes for every text row
+    {
+        ofstream f("bench_recordbuffer.txt", ios::binary);
+        RecordBuffer record;
+        HistoricalRowWriter row(record);
+        auto start = chrono::steady_clock::now();
+        for (long i = 0; i < rows; ++i)
+        {
+            record.Put<5>(i + 1);
+            ExecutionSchema::Columns(row, order);
+            record.EndLine();
+            f.write(record.GetData(), record.GetSize());
+            record.Clear();
+        }
+        f.flush();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "RecordBuffer rows: " << rows / seconds << " rows/s" << endl;
+    }
+}
+
+// Events/sec of trades booked or amended through booking, position and risk
+void RunTradeBenchmark(long events = BENCH_TRADE_EVENTS, int amendPercent = BENCH_AMEND_PERCENT)
+{
+    const char* cusips[] = { "912828M72", "912828N22", "912828M98", "912828M80", "912828M56", "912810RP5" };
+    const char* books[] = { "TRSY1", "TRSY2", "TRSY3" };
+    vector<Bond> bonds;
+    for (int i = 0; i < 6; ++i) bonds.push_back(Bond(cusips[i]));
+
+    //the flow is generated up front so only the services are timed
+    mt19937 rng(7);
+    vector<Trade<Bond>> flow;
+    vector<char> amend;
+    long booked = 0;
+    for (long i = 0; i < events; ++i)
+    {
+        bool is_amend = booked > 0 && long(rng() % 100) < amendPercent;
+        long id = is_amend ? long(rng() % booked) : booked++;
+        flow.push_back(Trade<Bond>(bonds[id % 6], "T" + to_string(id), books[rng() % 3],
+                                   long(rng() % 5 + 1) * 10000000, rng() % 2 ? BUY : SELL));
+        amend.push_back(is_amend);
+    }
+
+    BondTradeBookingService trade_srv(static_cast<size_t>(events));
+    BondPositionService position_srv;
+    BondTradeServiceListener trade_listener(position_srv);
+    trade_srv.AddListener(&trade_listener);
+    BondAnalytics analytics;
+    SectorDefinitions sectors;
+    sectors.Load("sectors.txt");
+    BondRiskService risk_srv(analytics, sectors);
+    BondPositionServiceListener position_listener(risk_srv);
+    position_srv.AddListener(&position_listener);
+
+    auto start = chrono::steady_clock::now();
+    for (long i = 0; i < events; ++i)
+    {
+        if (amend[i]) trade_srv.AmendTrade(flow[i]);
+        else trade_srv.OnMessage(flow[i]);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << events << " trade events (" << amendPercent << "% amends) in " << seconds << " s: "
+         << events / seconds << " events/s" << endl;
+}
+
+#endif
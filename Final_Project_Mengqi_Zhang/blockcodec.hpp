@@ -0,0 +1,176 @@
+/**
+ * blockcodec.hpp
+ * A small LZ77 block codec in the style of LZ4 for the historical data files.
+ * Every block is compressed on its own, so any block can be decoded without the others.
+ *
+ * A compressed block is a list of sequences. Each sequence is a token byte whose high
+ * nibble is the literal length and whose low nibble is the match length minus 4,
+ * then extra literal length bytes, the literals, a 2-byte little-endian match offset
+ * and extra match length bytes. A nibble of 15 is followed by extra length bytes that
+ * are added to it until a byte below 255. The last sequence has literals only.
+ */
+#ifndef BLOCK_CODEC_HPP
+#define BLOCK_CODEC_HPP
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Matches must leave this many literals at the end of a block
+const size_t LZ_LAST_LITERALS = 5;
+
+// Blocks shorter than this are stored as literals only
+const size_t LZ_MIN_INPUT = 13;
+
+// Size of the match finder hash table
+const int LZ_HASH_BITS = 12;
+
+// Upper bound of the compressed size of an input of the given length
+size_t LZCompressBound(size_t length);
+
+// Compress a block into output, which must hold LZCompressBound(length) bytes
+// Returns the compressed size
+size_t LZCompress(const char *input, size_t length, char *output);
+
+// Decompress a block of the given compressed size into output, which holds capacity bytes
+// Returns the decompressed size, or -1 if the block is corrupt
+long LZDecompress(const char *input, size_t length, char *output, size_t capacity);
+
+size_t LZCompressBound(size_t length)
+{
+    return length + length / 255 + 16;
+}
+
+inline uint32_t LZRead32(const char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t LZHash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+inline char* LZWriteLength(char *op, size_t length)
+{
+    while (length >= 255)
+    {
+        *op++ = char(255);
+        length -= 255;
+    }
+    *op++ = char(length);
+    return op;
+}
+
+inline char* LZWriteSequence(char *op, const char *literals, size_t literal_length, size_t offset, size_t match_length)
+{
+    char *token = op++;
+    *token = char((literal_length < 15 ? literal_length : 15) << 4);
+    if (literal_length >= 15) op = LZWriteLength(op, literal_length - 15);
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+    if (match_length == 0) return op;
+
+    *op++ = char(offset & 0xff);
+    *op++ = char(offset >> 8);
+    size_t length_code = match_length - 4;
+    *token |= char(length_code < 15 ? length_code : 15);
+    if (length_code >= 15) op = LZWriteLength(op, length_code - 15);
+    return op;
+}
+
+size_t LZCompress(const char *input, size_t length, char *output)
+{
+    char *op = output;
+    size_t anchor = 0;
+
+    if (length >= LZ_MIN_INPUT)
+    {
+        // positions are stored plus one so that zero means empty
+        vector<uint32_t> table(size_t(1) << LZ_HASH_BITS, 0);
+        size_t match_limit = length - LZ_LAST_LITERALS;
+        size_t ip = 0;
+        while (ip + LZ_MIN_INPUT - 1 < length)
+        {
+            uint32_t sequence = LZRead32(input + ip);
+            uint32_t &slot = table[LZHash(sequence)];
+            size_t candidate = slot;
+            slot = uint32_t(ip + 1);
+            if (candidate == 0 || ip + 1 - candidate > 65535 || LZRead32(input + candidate - 1) != sequence)
+            {
+                ++ip;
+                continue;
+            }
+
+            size_t ref = candidate - 1;
+            size_t match_length = 4;
+            while (ip + match_length < match_limit && input[ref + match_length] == input[ip + match_length]) ++match_length;
+
+            op = LZWriteSequence(op, input + anchor, ip - anchor, ip - ref, match_length);
+            ip += match_length;
+            anchor = ip;
+        }
+    }
+
+    op = LZWriteSequence(op, input + anchor, length - anchor, 0, 0);
+    return op - output;
+}
+
+long LZDecompress(const char *input, size_t length, char *output, size_t capacity)
+{
+    const unsigned char *ip = (const unsigned char*)input;
+    const unsigned char *end = ip + length;
+    size_t op = 0;
+
+    while (ip < end)
+    {
+        unsigned token = *ip++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15)
+        {
+            unsigned extra;
+            do
+            {
+                if (ip >= end) return -1;
+                extra = *ip++;
+                literal_length += extra;
+            } while (extra == 255);
+        }
+        if (literal_length > size_t(end - ip) || literal_length > capacity - op) return -1;
+        memcpy(output + op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // the last sequence has no match
+        if (ip == end) break;
+
+        if (end - ip < 2) return -1;
+        size_t offset = ip[0] | (size_t(ip[1]) << 8);
+        ip += 2;
+        size_t match_length = (token & 15) + 4;
+        if ((token & 15) == 15)
+        {
+            unsigned extra;
+            do
+            {
+                if (ip >= end) return -1;
+                extra = *ip++;
+                match_length += extra;
+            } while (extra == 255);
+        }
+        if (offset == 0 || offset > op || match_length > capacity - op) return -1;
+
+        // byte by byte since the match may overlap the bytes it produces
+        const char *match = output + op - offset;
+        for (size_t i = 0; i < match_length; ++i) output[op + i] = match[i];
+        op += match_length;
+    }
+    return long(op);
+}
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * bloomfilter.hpp
+ * A blocked Bloom filter over string keys.
+ * Every key maps to a single 64-byte block and sets one bit in each of its eight words,
+ * so a lookup touches one cache line and costs one hash of the key.
+ * A negative answer is exact; a positive answer may be false and must be confirmed elsewhere.
+ */
+#ifndef BLOOM_FILTER_HPP
+#define BLOOM_FILTER_HPP
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+// Number of 64-bit words in a block, one cache line
+const size_t BLOOM_BLOCK_WORDS = 8;
+
+// Default filter size in bits per expected key, about 2% false positives
+const size_t BLOOM_BITS_PER_KEY = 10;
+
+// Odd constants that pick a different bit in each word of a block
+const uint32_t BLOOM_SALTS[BLOOM_BLOCK_WORDS] = { 0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                                  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+
+/**
+ * Blocked Bloom filter sized for a number of expected keys.
+ * The memory is zeroed lazily by the operating system, so a large filter costs
+ * nothing until the blocks are used.
+ */
+class BlockedBloomFilter
+{
+
+public:
+
+  // ctor for a filter sized for expectedKeys at bitsPerKey bits each
+  BlockedBloomFilter(size_t expectedKeys, size_t bitsPerKey = BLOOM_BITS_PER_KEY);
+  ~BlockedBloomFilter();
+
+  // Insert a key
+  void Add(const string &key);
+
+  // Check whether a key may have been inserted; false means it never was
+  bool MayContain(const string &key) const;
+
+  // Get the memory used by the filter in bytes
+  size_t GetSize() const;
+
+private:
+  void *memory;
+  uint64_t *blocks;
+  size_t blockCount;
+
+  BlockedBloomFilter(const BlockedBloomFilter&);
+  BlockedBloomFilter& operator=(const BlockedBloomFilter&);
+
+  static uint64_t Hash(const string &key);
+  uint64_t* Block(uint64_t hash) const;
+
+};
+
+BlockedBloomFilter::BlockedBloomFilter(size_t expectedKeys, size_t bitsPerKey)
+{
+    size_t bits = expectedKeys * bitsPerKey;
+    blockCount = bits / (BLOOM_BLOCK_WORDS * 64) + 1;
+    // one spare block so the blocks can start on a cache line boundary
+    memory = calloc((blockCount + 1) * BLOOM_BLOCK_WORDS, sizeof(uint64_t));
+    if (!memory)
+    {
+        cout << "Bloom filter allocation failed!" << endl;
+        exit(-1);
+    }
+    const size_t line = BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+    blocks = reinterpret_cast<uint64_t*>((reinterpret_cast<uintptr_t>(memory) + line - 1) / line * line);
+}
+
+BlockedBloomFilter::~BlockedBloomFilter()
+{
+    free(memory);
+}
+
+//64-bit FNV-1a with a final mix, so both halves of the hash are well spread
+uint64_t BlockedBloomFilter::Hash(const string &key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+//the high half of the hash picks the block without a division
+uint64_t* BlockedBloomFilter::Block(uint64_t hash) const
+{
+    size_t block = size_t(((hash >> 32) * uint64_t(blockCount)) >> 32);
+    return blocks + block * BLOOM_BLOCK_WORDS;
+}
+
+void BlockedBloomFilter::Add(const string &key)
+{
+    uint64_t hash = Hash(key);
+    uint64_t *block = Block(hash);
+    uint32_t low = uint32_t(hash);
+    for (size_t i = 0; i < BLOOM_BLOCK_WORDS; ++i)
+    {
+        block[i] |= uint64_t(1) << ((low * BLOOM_SALTS[i]) >> 26);
+    }
+}
+
+bool BlockedBloomFilter::MayContain(const string &key) const
+{
+    uint64_t hash = Hash(key);
+    const uint64_t *block = Block(hash);
+    uint32_t low = uint32_t(hash);
+    for (size_t i = 0; i < BLOOM_BLOCK_WORDS; ++i)
+    {
+        if (!(block[i] & (uint64_t(1) << ((low * BLOOM_SALTS[i]) >> 26)))) return false;
+    }
+    return true;
+}
+
+size_t BlockedBloomFilter::GetSize() const
+{
+    return blockCount * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+#endif
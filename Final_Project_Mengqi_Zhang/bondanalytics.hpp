@@ -0,0 +1,561 @@
+/**
+ * bondanalytics.hpp
+ * Fixed-rate bond analytics: coupon schedules, yield from price and PV01.
+ *
+ * A schedule is built once per product from the Bond coupon and maturity date, with
+ * semi-annual coupons rolled back from maturity and actual/actual accrual. Schedules are
+ * kept in structure-of-arrays form, one column per product, so that the pricing kernel
+ * walks the cashflows of every product in lockstep and its inner loop over products
+ * has no branches or transcendental calls and can be vectorized.
+ *
+ * Prices, accrued interest and PV01 are per 100 face; PV01 is the dirty price change
+ * for a one basis point fall in yield.
+ *
+ * Key rate PV01s split the PV01 of a bond across tenor points. A key rate shift moves
+ * yields by 1bp at its tenor, fading linearly to 0 at the neighbouring tenors and
+ * staying flat beyond the first and last tenor, so the key rate PV01s of a bond add up
+ * to its PV01.
+ */
+#ifndef BOND_ANALYTICS_HPP
+#define BOND_ANALYTICS_HPP
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <unordered_map>
+#include "products.hpp"
+#include "threadpool.hpp"
+
+using namespace std;
+
+// Settlement date the analytics are computed for, the date of the input files
+const date ANALYTICS_SETTLEMENT_DATE(2016, Dec, 9);
+
+// Coupon periods per year
+const int COUPON_FREQUENCY = 2;
+
+// Newton steps of the yield solver, and the price error it stops at
+const int YIELD_MAX_ITERATIONS = 20;
+const double YIELD_PRICE_TOLERANCE = 1e-10;
+
+// Products evaluated together, sized so the kernel's per-product arrays stay in L1
+const size_t ANALYTICS_TILE = 128;
+
+// Default key rate tenors in years
+const double KEY_RATE_TENORS[] = { 2, 3, 5, 7, 10, 30 };
+const size_t KEY_RATE_COUNT = sizeof(KEY_RATE_TENORS) / sizeof(KEY_RATE_TENORS[0]);
+
+// Most key rate tenors a ladder can have
+const size_t MAX_KEY_RATES = 16;
+
+// One basis point
+const double BASIS_POINT = 0.0001;
+
+/**
+ * Scratch of a yield solve on caller storage, so threads can solve at once.
+ */
+struct YieldWorkspace
+{
+    vector<double> dirty;
+    vector<double> slope;
+    vector<double> discount;
+    vector<double> factor;
+    vector<char> done;
+};
+
+/**
+ * Schedules and analytics of a universe of fixed-rate bonds, addressed by slot.
+ */
+class BondAnalytics
+{
+
+public:
+
+  // ctor for an empty universe; full revaluations are spread over pool when one is given
+  BondAnalytics(const date &_settlement = ANALYTICS_SETTLEMENT_DATE, ThreadPool *_pool = 0);
+
+  // Get the slot of a bond, building and caching its schedule on first sight
+  // A new bond is priced at par until it gets a price
+  size_t AddBond(const Bond &bond);
+
+  // Get the slot of a bond, or -1 if it was never added
+  long FindBond(const string &cusip) const;
+
+  // Get the number of bonds
+  size_t Size() const;
+
+  // Get the bond in a slot
+  const Bond& GetBond(size_t slot) const;
+
+  // Set the clean price of one bond and solve its yield and PV01
+  void SetPrice(size_t slot, double price);
+
+  // Set the clean prices of all bonds, in slot order, and solve them together
+  void SetPrices(const double *prices);
+
+  // Set the yield of one bond and reprice it
+  void SetYield(size_t slot, double yield);
+
+  // Solve every bond again from its current price
+  void Revalue();
+
+  // Replace the key rate tenors, in increasing years; set them before any risk is taken on the ladder
+  void SetKeyRateTenors(const vector<double> &_tenors);
+
+  // Get the number of key rate tenors
+  size_t GetKeyRateCount() const;
+
+  // Get a key rate tenor in years
+  double GetKeyRateTenor(size_t tenor) const;
+
+  // Solve the yields of all bonds for the given dirty prices, in slot order
+  // yields hold the starting guesses and get the results; work is scratch owned by the caller
+  void SolveYields(const double *dirtyPrices, double *yields, YieldWorkspace &work) const;
+
+  // Get the dirty prices of all bonds at the given yields, in slot order
+  // discount and factor are scratch with one entry per bond, so threads can reprice at once
+  void Reprice(const double *yields, double *dirtyPrices, double *discount, double *factor) const;
+
+  // Get the clean price
+  double GetPrice(size_t slot) const;
+
+  // Get the accrued interest
+  double GetAccrued(size_t slot) const;
+
+  // Get the yield, semi-annual compounding
+  double GetYield(size_t slot) const;
+
+  // Get the PV01
+  double GetPV01(size_t slot) const;
+
+  // Get the PV01 to a key rate
+  double GetKeyRate01(size_t slot, size_t tenor) const;
+
+  // Get the settlement date
+  const date& GetSettlement() const;
+
+private:
+  date settlement;
+  ThreadPool *pool;
+  vector<Bond> bonds;
+  unordered_map<string, size_t> index;//map from cusip to its slot
+
+  // schedule, cashflow k of the bond in slot p is at amount[k * capacity + p]
+  size_t capacity;
+  size_t maxFlows;
+  vector<double> amount;//cashflow per 100 face, 0 past maturity
+  vector<size_t> flowCount;//number of cashflows of each product
+  vector<double> first;//periods from settlement to the first cashflow
+  vector<double> accrued;
+
+  // analytics
+  vector<double> price;//clean
+  vector<double> yield;
+  vector<double> pv01;
+  vector<double> keyRate;//key rate PV01 of slot p for tenor i at keyRate[i * capacity + p]
+
+  // key rate weights, min(clamp(upSlope * t + upBase), clamp(downSlope * t + downBase)) for tenor i
+  vector<double> tenors;
+  vector<double> upSlope;
+  vector<double> upBase;
+  vector<double> downSlope;
+  vector<double> downBase;
+
+  // kernel scratch
+  vector<double> discount;
+  vector<double> factor;
+  vector<double> dirty;
+  vector<double> slope;
+  vector<double> target;
+  vector<double> weighted;
+  vector<char> done;
+
+  void Reserve(size_t _capacity, size_t _maxFlows);
+  void Evaluate(size_t begin, size_t end, const double *yields, double *dirtyPrices, double *slopes,
+                double *discounts, double *factors) const;
+  void Newton(size_t begin, size_t end, const double *targets, double *yields, double *dirtyPrices, double *slopes,
+              double *discounts, double *factors, char *converged) const;
+  void Evaluate(size_t begin, size_t end);
+  void Solve(size_t begin, size_t end);
+  void KeyRates(size_t begin, size_t end);
+  void SolveAll();
+
+};
+
+BondAnalytics::BondAnalytics(const date &_settlement, ThreadPool *_pool) : settlement(_settlement), pool(_pool), capacity(0), maxFlows(0)
+{
+    SetKeyRateTenors(vector<double>(KEY_RATE_TENORS, KEY_RATE_TENORS + KEY_RATE_COUNT));
+}
+
+//grow the schedule matrix; only happens while the universe is being loaded
+void BondAnalytics::Reserve(size_t _capacity, size_t _maxFlows)
+{
+    if (_capacity <= capacity && _maxFlows <= maxFlows) return;
+    size_t new_capacity = capacity;
+    while (new_capacity < _capacity) new_capacity = new_capacity ? new_capacity * 2 : 16;
+    size_t new_flows = maxFlows > _maxFlows ? maxFlows : _maxFlows;
+
+    vector<double> new_amount(new_capacity * new_flows, 0);
+    for (size_t k = 0; k < maxFlows; ++k)
+        for (size_t p = 0; p < bonds.size(); ++p)
+            new_amount[k * new_capacity + p] = amount[k * capacity + p];
+    amount.swap(new_amount);
+    vector<double> new_key_rate(new_capacity * tenors.size(), 0);
+    for (size_t i = 0; i < tenors.size(); ++i)
+        for (size_t p = 0; p < bonds.size(); ++p)
+            new_key_rate[i * new_capacity + p] = keyRate[i * capacity + p];
+    keyRate.swap(new_key_rate);
+    capacity = new_capacity;
+    maxFlows = new_flows;
+
+    flowCount.resize(capacity);
+    first.resize(capacity);
+    accrued.resize(capacity);
+    price.resize(capacity);
+    yield.resize(capacity);
+    pv01.resize(capacity);
+    discount.resize(capacity);
+    factor.resize(capacity);
+    dirty.resize(capacity);
+    slope.resize(capacity);
+    target.resize(capacity);
+    weighted.resize(capacity);
+    done.resize(capacity);
+}
+
+size_t BondAnalytics::AddBond(const Bond &bond)
+{
+    auto iter = index.find(bond.GetProductId());
+    if (iter != index.end()) return iter->second;
+
+    //coupon dates roll back from maturity until the one before settlement
+    const date &maturity = bond.GetMaturityDate();
+    size_t flows = 0;
+    date previous = maturity;
+    if (!maturity.is_special())
+    {
+        while (previous > settlement) previous = maturity - months(6 * ++flows);
+    }
+    double coupon = bond.GetCoupon() / COUPON_FREQUENCY;
+
+    size_t slot = bonds.size();
+    Reserve(slot + 1, flows);
+    bonds.push_back(bond);
+    index[bond.GetProductId()] = slot;
+
+    flowCount[slot] = flows;
+    first[slot] = 0;
+    accrued[slot] = 0;
+    if (flows > 0)
+    {
+        date next = maturity - months(6 * (flows - 1));
+        double period = (next - previous).days();
+        first[slot] = (next - settlement).days() / period;
+        accrued[slot] = coupon * (1 - first[slot]);
+        for (size_t k = 0; k < flows; ++k) amount[k * capacity + slot] = coupon;
+        amount[(flows - 1) * capacity + slot] += 100;
+    }
+    SetYield(slot, bond.GetCoupon() / 100);
+    return slot;
+}
+
+long BondAnalytics::FindBond(const string &cusip) const
+{
+    auto iter = index.find(cusip);
+    return iter == index.end() ? -1 : long(iter->second);
+}
+
+size_t BondAnalytics::Size() const
+{
+    return bonds.size();
+}
+
+const Bond& BondAnalytics::GetBond(size_t slot) const
+{
+    return bonds[slot];
+}
+
+//dirty price and its derivative with respect to the yield for slots [begin, end)
+//the discount of cashflow k is v^(first + k), so it is carried from one cashflow to the next by a multiply
+void BondAnalytics::Evaluate(size_t begin, size_t end, const double *yields, double *dirtyPrices, double *slopes,
+                             double *discounts, double *factors) const
+{
+    size_t flows = 0;
+    for (size_t p = begin; p < end; ++p)
+    {
+        factors[p] = 1 / (1 + yields[p] / COUPON_FREQUENCY);
+        discounts[p] = pow(factors[p], first[p]);
+        dirtyPrices[p] = 0;
+        slopes[p] = 0;
+        if (flowCount[p] > flows) flows = flowCount[p];
+    }
+    //the arrays never overlap; saying so lets the compiler vectorize without runtime checks
+    double *__restrict__ discount_p = discounts;
+    double *__restrict__ dirty_p = dirtyPrices;
+    double *__restrict__ slope_p = slopes;
+    const double *__restrict__ factor_p = factors;
+    const double *__restrict__ first_p = first.data();
+    for (size_t tile = begin; tile < end; tile += ANALYTICS_TILE)
+    {
+        size_t tile_end = tile + ANALYTICS_TILE < end ? tile + ANALYTICS_TILE : end;
+        for (size_t k = 0; k < flows; ++k)
+        {
+            const double *__restrict__ cashflow = &amount[k * capacity];
+            double periods = double(k);
+            for (size_t p = tile; p < tile_end; ++p)
+            {
+                double value = cashflow[p] * discount_p[p];
+                dirty_p[p] += value;
+                slope_p[p] += value * (first_p[p] + periods);
+                discount_p[p] *= factor_p[p];
+            }
+        }
+    }
+    //turn the time-weighted sum into dP/dy
+    for (size_t p = begin; p < end; ++p) slopes[p] *= -factors[p] / COUPON_FREQUENCY;
+}
+
+void BondAnalytics::Evaluate(size_t begin, size_t end)
+{
+    Evaluate(begin, end, yield.data(), dirty.data(), slope.data(), discount.data(), factor.data());
+}
+
+//Newton on all slots in lockstep, starting from the given yields
+//a tile is evaluated again only while one of its slots has not converged, so a warm start costs one pass
+void BondAnalytics::Newton(size_t begin, size_t end, const double *targets, double *yields, double *dirtyPrices, double *slopes,
+                           double *discounts, double *factors, char *converged) const
+{
+    for (size_t p = begin; p < end; ++p) converged[p] = 0;
+    for (int iteration = 0; iteration < YIELD_MAX_ITERATIONS; ++iteration)
+    {
+        bool all = true;
+        for (size_t tile = begin; tile < end; tile += ANALYTICS_TILE)
+        {
+            size_t tile_end = tile + ANALYTICS_TILE < end ? tile + ANALYTICS_TILE : end;
+            bool pending = false;
+            for (size_t p = tile; p < tile_end; ++p) pending = pending || !converged[p];
+            if (!pending) continue;
+            Evaluate(tile, tile_end, yields, dirtyPrices, slopes, discounts, factors);
+            for (size_t p = tile; p < tile_end; ++p)
+            {
+                double error = dirtyPrices[p] - targets[p];
+                converged[p] = converged[p] || fabs(error) < YIELD_PRICE_TOLERANCE || slopes[p] == 0;
+                if (!converged[p]) yields[p] -= error / slopes[p];
+                all = all && converged[p];
+            }
+        }
+        if (all) break;
+    }
+}
+
+void BondAnalytics::Solve(size_t begin, size_t end)
+{
+    Newton(begin, end, target.data(), yield.data(), dirty.data(), slope.data(), discount.data(), factor.data(), done.data());
+    Evaluate(begin, end);
+    for (size_t p = begin; p < end; ++p)
+    {
+        price[p] = dirty[p] - accrued[p];
+        pv01[p] = -slope[p] * BASIS_POINT;
+    }
+    KeyRates(begin, end);
+}
+
+//same walk as Evaluate, with each cashflow's share of dP/dy spread over the tenors by weight
+void BondAnalytics::KeyRates(size_t begin, size_t end)
+{
+    size_t flows = 0;
+    size_t count = tenors.size();
+    for (size_t p = begin; p < end; ++p)
+    {
+        factor[p] = 1 / (1 + yield[p] / COUPON_FREQUENCY);
+        discount[p] = pow(factor[p], first[p]);
+        for (size_t i = 0; i < count; ++i) keyRate[i * capacity + p] = 0;
+        if (flowCount[p] > flows) flows = flowCount[p];
+    }
+    double *__restrict__ discount_p = discount.data();
+    double *__restrict__ weighted_p = weighted.data();
+    const double *__restrict__ factor_p = factor.data();
+    const double *__restrict__ first_p = first.data();
+    for (size_t tile = begin; tile < end; tile += ANALYTICS_TILE)
+    {
+        size_t tile_end = tile + ANALYTICS_TILE < end ? tile + ANALYTICS_TILE : end;
+        for (size_t k = 0; k < flows; ++k)
+        {
+            const double *__restrict__ cashflow = &amount[k * capacity];
+            double periods = double(k);
+            for (size_t p = tile; p < tile_end; ++p)
+            {
+                weighted_p[p] = cashflow[p] * discount_p[p] * (first_p[p] + periods);
+                discount_p[p] *= factor_p[p];
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                double *__restrict__ key_rate = &keyRate[i * capacity];
+                double up_slope = upSlope[i], up_base = upBase[i], down_slope = downSlope[i], down_base = downBase[i];
+                for (size_t p = tile; p < tile_end; ++p)
+                {
+                    double t = (first_p[p] + periods) / COUPON_FREQUENCY;
+                    double up = up_slope * t + up_base;
+                    double down = down_slope * t + down_base;
+                    double weight = up < down ? up : down;
+                    weight = weight < 0 ? 0 : weight > 1 ? 1 : weight;
+                    key_rate[p] += weighted_p[p] * weight;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < count; ++i)
+        for (size_t p = begin; p < end; ++p) keyRate[i * capacity + p] *= factor[p] / COUPON_FREQUENCY * BASIS_POINT;
+}
+
+//full revaluations are split into tiles over the pool; slots never share scratch entries
+void BondAnalytics::SolveAll()
+{
+    if (!pool)
+    {
+        Solve(0, bonds.size());
+        return;
+    }
+    pool->ParallelFor(bonds.size(), ANALYTICS_TILE, [this](size_t begin, size_t end) { Solve(begin, end); });
+}
+
+void BondAnalytics::Revalue()
+{
+    for (size_t p = 0; p < bonds.size(); ++p) target[p] = price[p] + accrued[p];
+    SolveAll();
+}
+
+//a tenor's weight rises from the previous tenor and falls to the next; the ends stay flat
+void BondAnalytics::SetKeyRateTenors(const vector<double> &_tenors)
+{
+    if (_tenors.empty() || _tenors.size() > MAX_KEY_RATES)
+    {
+        cout << "Bad number of key rate tenors: " << _tenors.size() << endl;
+        exit(-1);
+    }
+    tenors = _tenors;
+    size_t count = tenors.size();
+    upSlope.assign(count, 0);
+    upBase.assign(count, 1);
+    downSlope.assign(count, 0);
+    downBase.assign(count, 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i > 0)
+        {
+            upSlope[i] = 1 / (tenors[i] - tenors[i - 1]);
+            upBase[i] = -tenors[i - 1] * upSlope[i];
+        }
+        if (i + 1 < count)
+        {
+            downSlope[i] = -1 / (tenors[i + 1] - tenors[i]);
+            downBase[i] = tenors[i + 1] / (tenors[i + 1] - tenors[i]);
+        }
+    }
+    keyRate.assign(capacity * count, 0);
+    for (size_t p = 0; p < bonds.size(); ++p) KeyRates(p, p + 1);
+}
+
+void BondAnalytics::SolveYields(const double *dirtyPrices, double *yields, YieldWorkspace &work) const
+{
+    size_t count = bonds.size();
+    work.dirty.resize(count);
+    work.slope.resize(count);
+    work.discount.resize(count);
+    work.factor.resize(count);
+    work.done.resize(count);
+    Newton(0, count, dirtyPrices, yields, work.dirty.data(), work.slope.data(), work.discount.data(), work.factor.data(), work.done.data());
+}
+
+//Evaluate without the slope, on caller storage
+void BondAnalytics::Reprice(const double *yields, double *dirtyPrices, double *discount, double *factor) const
+{
+    size_t count = bonds.size();
+    size_t flows = 0;
+    for (size_t p = 0; p < count; ++p)
+    {
+        factor[p] = 1 / (1 + yields[p] / COUPON_FREQUENCY);
+        discount[p] = pow(factor[p], first[p]);
+        dirtyPrices[p] = 0;
+        if (flowCount[p] > flows) flows = flowCount[p];
+    }
+    double *__restrict__ discount_p = discount;
+    double *__restrict__ dirty_p = dirtyPrices;
+    const double *__restrict__ factor_p = factor;
+    for (size_t tile = 0; tile < count; tile += ANALYTICS_TILE)
+    {
+        size_t tile_end = tile + ANALYTICS_TILE < count ? tile + ANALYTICS_TILE : count;
+        for (size_t k = 0; k < flows; ++k)
+        {
+            const double *__restrict__ cashflow = &amount[k * capacity];
+            for (size_t p = tile; p < tile_end; ++p)
+            {
+                dirty_p[p] += cashflow[p] * discount_p[p];
+                discount_p[p] *= factor_p[p];
+            }
+        }
+    }
+}
+
+size_t BondAnalytics::GetKeyRateCount() const
+{
+    return tenors.size();
+}
+
+double BondAnalytics::GetKeyRateTenor(size_t tenor) const
+{
+    return tenors[tenor];
+}
+
+void BondAnalytics::SetPrice(size_t slot, double _price)
+{
+    target[slot] = _price + accrued[slot];
+    Solve(slot, slot + 1);
+}
+
+void BondAnalytics::SetPrices(const double *prices)
+{
+    for (size_t p = 0; p < bonds.size(); ++p) target[p] = prices[p] + accrued[p];
+    SolveAll();
+}
+
+void BondAnalytics::SetYield(size_t slot, double _yield)
+{
+    yield[slot] = _yield;
+    Evaluate(slot, slot + 1);
+    price[slot] = dirty[slot] - accrued[slot];
+    pv01[slot] = -slope[slot] * BASIS_POINT;
+    KeyRates(slot, slot + 1);
+}
+
+double BondAnalytics::GetPrice(size_t slot) const
+{
+    return price[slot];
+}
+
+double BondAnalytics::GetAccrued(size_t slot) const
+{
+    return accrued[slot];
+}
+
+double BondAnalytics::GetYield(size_t slot) const
+{
+    return yield[slot];
+}
+
+double BondAnalytics::GetPV01(size_t slot) const
+{
+    return pv01[slot];
+}
+
+double BondAnalytics::GetKeyRate01(size_t slot, size_t tenor) const
+{
+    return keyRate[tenor * capacity + slot];
+}
+
+const date& BondAnalytics::GetSettlement() const
+{
+    return settlement;
+}
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * chunkedarena.hpp
+ * Append-only storage made of fixed-size chunks.
+ * Elements never move once added, so references and slot numbers stay valid for the
+ * lifetime of the arena and growing it never copies the elements already stored.
+ */
+#ifndef CHUNKED_ARENA_HPP
+#define CHUNKED_ARENA_HPP
+
+#include <vector>
+#include <new>
+
+using namespace std;
+
+/**
+ * Chunked arena of T, addressed by slot number.
+ * Type T is the element type, ChunkSize the number of elements per chunk.
+ */
+template<typename T, size_t ChunkSize = 4096>
+class ChunkedArena
+{
+
+public:
+
+  // ctor for an empty arena
+  ChunkedArena();
+  ~ChunkedArena();
+
+  // Copy an element into the arena and get its slot
+  size_t Add(const T &value);
+
+  // Default construct an element in the arena and get its slot
+  size_t Add();
+
+  // Get the element in a slot
+  T& operator[](size_t slot);
+  const T& operator[](size_t slot) const;
+
+  // Get the number of elements
+  size_t Size() const;
+
+private:
+  vector<T*> chunks;
+  size_t size;
+
+  ChunkedArena(const ChunkedArena&);
+  ChunkedArena& operator=(const ChunkedArena&);
+
+};
+
+template<typename T, size_t ChunkSize>
+ChunkedArena<T, ChunkSize>::ChunkedArena() : size(0)
+{
+}
+
+template<typename T, size_t ChunkSize>
+ChunkedArena<T, ChunkSize>::~ChunkedArena()
+{
+    for (size_t i = 0; i < size; ++i) (*this)[i].~T();
+    for (size_t i = 0; i < chunks.size(); ++i) ::operator delete(chunks[i]);
+}
+
+template<typename T, size_t ChunkSize>
+size_t ChunkedArena<T, ChunkSize>::Add(const T &value)
+{
+    if (size == chunks.size() * ChunkSize)
+    {
+        chunks.push_back(static_cast<T*>(::operator new(sizeof(T) * ChunkSize)));
+    }
+    new (chunks[size / ChunkSize] + size % ChunkSize) T(value);
+    return size++;
+}
+
+template<typename T, size_t ChunkSize>
+size_t ChunkedArena<T, ChunkSize>::Add()
+{
+    if (size == chunks.size() * ChunkSize)
+    {
+        chunks.push_back(static_cast<T*>(::operator new(sizeof(T) * ChunkSize)));
+    }
+    new (chunks[size / ChunkSize] + size % ChunkSize) T();
+    return size++;
+}
+
+template<typename T, size_t ChunkSize>
+T& ChunkedArena<T, ChunkSize>::operator[](size_t slot)
+{
+    return chunks[slot / ChunkSize][slot % ChunkSize];
+}
+
+template<typename T, size_t ChunkSize>
+const T& ChunkedArena<T, ChunkSize>::operator[](size_t slot) const
+{
+    return chunks[slot / ChunkSize][slot % ChunkSize];
+}
+
+template<typename T, size_t ChunkSize>
+size_t ChunkedArena<T, ChunkSize>::Size() const
+{
+    return size;
+}
+
+#endif
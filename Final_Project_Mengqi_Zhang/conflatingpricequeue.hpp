@@ -0,0 +1,224 @@
+/**
+ * conflatingpricequeue.hpp
+ * A conflating stage between the pricing service and its slower consumers.
+ *
+ * The stage keeps only the latest pending price of each product. A new price for a
+ * product that is already pending replaces it in place and counts as conflated, so the
+ * backlog is never more than one price per product and a drain always publishes the
+ * freshest prices, in the order the products first became pending.
+ *
+ * With a consumer thread started, prices are published from that thread whenever some
+ * are pending. Without one, every push is drained on the pushing thread and nothing is
+ * conflated; prices must then come from a single thread.
+ */
+#ifndef CONFLATING_PRICE_QUEUE_HPP
+#define CONFLATING_PRICE_QUEUE_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+
+using namespace std;
+
+/**
+ * Conflating queue of bond prices, listening to the pricing service and publishing to
+ * its own listeners.
+ */
+class ConflatingPriceQueue : public ServiceListener<Price<Bond>>
+{
+
+public:
+
+  // ctor for an empty stage that drains inline
+  ConflatingPriceQueue();
+  ~ConflatingPriceQueue();
+
+  // Add a downstream listener
+  void AddListener(ServiceListener<Price<Bond>> *listener);
+
+  // Take a price from the pricing service
+  void ProcessAdd(Price<Bond> &price);
+  void ProcessRemove(Price<Bond> &price) {}
+  void ProcessUpdate(Price<Bond> &price) {}
+
+  // Make a price the pending price of its product
+  void Push(const Price<Bond> &price);
+
+  // Publish every pending price once and get how many were published
+  // Only one thread may drain at a time: the consumer thread when it runs
+  size_t Drain();
+
+  // Start publishing from a consumer thread
+  void Start();
+
+  // Publish what is still pending and stop the consumer thread
+  void Stop();
+
+  // Get the number of prices replaced before they were published
+  long GetConflatedCount() const;
+
+  // Get the number of prices published
+  long GetPublishedCount() const;
+
+  // Get the number of products with a pending price
+  size_t GetPendingCount();
+
+private:
+  vector<ServiceListener<Price<Bond>>*> listener_list;
+  mutex lock;
+  condition_variable ready;
+
+  // guarded by lock
+  unordered_map<string, size_t> index;//map from cusip to its slot
+  vector<Price<Bond>> pending;//latest price of each slot
+  vector<char> dirty_flag;//is the price of a slot waiting to be published?
+  vector<size_t> dirty;//slots waiting to be published, in the order they became dirty
+  bool running;
+  bool stopping;
+
+  // consumer side, reused between drains
+  vector<Price<Bond>> outgoing;
+
+  thread consumer;
+  atomic<long> conflated;
+  atomic<long> published;
+
+  void ConsumerLoop();
+
+};
+
+ConflatingPriceQueue::ConflatingPriceQueue() : running(false), stopping(false), conflated(0), published(0)
+{
+}
+
+ConflatingPriceQueue::~ConflatingPriceQueue()
+{
+    Stop();
+}
+
+void ConflatingPriceQueue::AddListener(ServiceListener<Price<Bond>> *listener)
+{
+    listener_list.push_back(listener);
+}
+
+void ConflatingPriceQueue::ProcessAdd(Price<Bond> &price)
+{
+    Push(price);
+}
+
+void ConflatingPriceQueue::Push(const Price<Bond> &price)
+{
+    bool inline_drain;
+    {
+        lock_guard<mutex> guard(lock);
+        const string &cusip = price.GetProduct().GetProductId();
+        auto iter = index.find(cusip);
+        size_t slot;
+        if (iter == index.end())
+        {
+            slot = pending.size();
+            index[cusip] = slot;
+            pending.push_back(price);
+            dirty_flag.push_back(0);
+        }
+        else
+        {
+            slot = iter->second;
+            pending[slot] = price;
+        }
+        if (dirty_flag[slot]) ++conflated;
+        else
+        {
+            dirty_flag[slot] = 1;
+            dirty.push_back(slot);
+        }
+        inline_drain = !running;
+    }
+    if (inline_drain) Drain();
+    else ready.notify_one();
+}
+
+//prices are copied out under the lock and published outside it, so pushes never wait on listeners
+size_t ConflatingPriceQueue::Drain()
+{
+    outgoing.clear();
+    {
+        lock_guard<mutex> guard(lock);
+        for (size_t i = 0; i < dirty.size(); ++i)
+        {
+            outgoing.push_back(pending[dirty[i]]);
+            dirty_flag[dirty[i]] = 0;
+        }
+        dirty.clear();
+    }
+    for (size_t i = 0; i < outgoing.size(); ++i)
+    {
+        for (size_t j = 0; j < listener_list.size(); ++j) listener_list[j]->ProcessAdd(outgoing[i]);
+    }
+    published += outgoing.size();
+    return outgoing.size();
+}
+
+void ConflatingPriceQueue::Start()
+{
+    lock_guard<mutex> guard(lock);
+    if (running) return;
+    running = true;
+    stopping = false;
+    consumer = thread(&ConflatingPriceQueue::ConsumerLoop, this);
+}
+
+void ConflatingPriceQueue::Stop()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        if (!running) return;
+        stopping = true;
+    }
+    ready.notify_one();
+    consumer.join();
+    {
+        lock_guard<mutex> guard(lock);
+        running = false;
+    }
+    //prices pushed after the consumer's last drain
+    Drain();
+}
+
+void ConflatingPriceQueue::ConsumerLoop()
+{
+    while (true)
+    {
+        bool last;
+        {
+            unique_lock<mutex> guard(lock);
+            while (dirty.empty() && !stopping) ready.wait(guard);
+            last = stopping;
+        }
+        Drain();
+        if (last) return;
+    }
+}
+
+long ConflatingPriceQueue::GetConflatedCount() const
+{
+    return conflated;
+}
+
+long ConflatingPriceQueue::GetPublishedCount() const
+{
+    return published;
+}
+
+size_t ConflatingPriceQueue::GetPendingCount()
+{
+    lock_guard<mutex> guard(lock);
+    return dirty.size();
+}
+
+#endif
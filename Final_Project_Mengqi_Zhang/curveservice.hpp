@@ -0,0 +1,304 @@
+/**
+ * curveservice.hpp
+ * A Nelson-Siegel yield curve fitted live to the mids of the on-the-run bonds.
+ *
+ *   y(t) = level + slope * f1(t / decay) + curvature * (f1(t / decay) - exp(-t / decay))
+ *   f1(x) = (1 - exp(-x)) / x
+ *
+ * For a given decay the other three parameters are a linear least squares fit, so a
+ * refit only searches the decay, by Newton steps on its log starting from the decay of
+ * the previous fit. A price that moves one point usually needs a single step.
+ * Refits are throttled to one per interval of prices, so the same prices always give the
+ * same fits; a price that does not refit marks the curve stale until the next refit or Flush.
+ * Yields are read from the shared analytics, solved there by PricingAnalyticsListener.
+ */
+#ifndef CURVE_SERVICE_HPP
+#define CURVE_SERVICE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+#include "bondanalytics.hpp"
+#include "sectordefinitions.hpp"
+
+using namespace std;
+
+// Default decay of the first fit in years
+const double CURVE_INITIAL_DECAY = 2.0;
+
+// Range the decay is searched in, in years
+const double CURVE_MIN_DECAY = 0.1;
+const double CURVE_MAX_DECAY = 30.0;
+
+// Newton steps of a refit and the step in log decay at which it stops
+const int CURVE_MAX_ITERATIONS = 10;
+const double CURVE_TOLERANCE = 1e-6;
+
+// Default number of prices between two refits
+const long CURVE_REFIT_INTERVAL = 64;
+
+/**
+ * Parameters of a fitted Nelson-Siegel curve.
+ */
+class YieldCurve
+{
+
+public:
+
+  // ctor for a flat zero curve and for a fitted one
+  YieldCurve();
+  YieldCurve(double _level, double _slope, double _curvature, double _decay, double _rmsError, long _fitNumber);
+
+  // Get the fitted yield at a time to maturity in years
+  double GetYield(double years) const;
+
+  // Get the parameters
+  double GetLevel() const;
+  double GetSlope() const;
+  double GetCurvature() const;
+  double GetDecay() const;
+
+  // Get the root mean square yield error of the fit
+  double GetRmsError() const;
+
+  // Get the number of the fit, 0 before the first
+  long GetFitNumber() const;
+
+private:
+  double level;
+  double slope;
+  double curvature;
+  double decay;
+  double rmsError;
+  long fitNumber;
+
+};
+
+/**
+ * Curve service for bonds, listening to the pricing service and publishing every fit.
+ */
+class BondCurveService : public ServiceListener<Price<Bond>>
+{
+
+public:
+
+  // ctor for a curve over the given bonds
+  BondCurveService(BondAnalytics &_analytics, const vector<string> &cusips, long _refitInterval = CURVE_REFIT_INTERVAL);
+
+  // Take a new price from the pricing service
+  void ProcessAdd(Price<Bond> &price);
+  void ProcessRemove(Price<Bond> &price) {}
+  void ProcessUpdate(Price<Bond> &price) {}
+
+  // Add a listener for fitted curves
+  void AddListener(ServiceListener<YieldCurve> *listener);
+
+  // Fit the curve now; needs yields on four bonds
+  void Refit();
+
+  // Fit the curve if a price arrived since the last fit
+  void Flush();
+
+  // Get the latest fit
+  const YieldCurve& GetCurve() const;
+
+  // Get the number of prices that did not refit because of the throttle
+  long GetThrottledCount() const;
+
+private:
+  BondAnalytics &analytics;
+  unordered_map<string, size_t> point_index;//map from cusip to its curve point
+  vector<double> years;//time to maturity of each point
+  vector<double> yields;//mid yield of each point
+  vector<char> priced;
+  size_t priced_count;
+  YieldCurve curve;
+  bool stale;
+  long throttled;
+  long refit_interval;
+  long since_fit;//prices since the last fit
+  vector<ServiceListener<YieldCurve>*> listener_list;
+
+  double Fit(double decay, double beta[3]) const;
+
+};
+
+YieldCurve::YieldCurve() : level(0), slope(0), curvature(0), decay(CURVE_INITIAL_DECAY), rmsError(0), fitNumber(0)
+{
+}
+
+YieldCurve::YieldCurve(double _level, double _slope, double _curvature, double _decay, double _rmsError, long _fitNumber) :
+level(_level), slope(_slope), curvature(_curvature), decay(_decay), rmsError(_rmsError), fitNumber(_fitNumber)
+{
+}
+
+double YieldCurve::GetYield(double years) const
+{
+    double x = years / decay;
+    double e = exp(-x);
+    double f1 = x > 1e-8 ? (1 - e) / x : 1;
+    return level + slope * f1 + curvature * (f1 - e);
+}
+
+double YieldCurve::GetLevel() const
+{
+    return level;
+}
+
+double YieldCurve::GetSlope() const
+{
+    return slope;
+}
+
+double YieldCurve::GetCurvature() const
+{
+    return curvature;
+}
+
+double YieldCurve::GetDecay() const
+{
+    return decay;
+}
+
+double YieldCurve::GetRmsError() const
+{
+    return rmsError;
+}
+
+long YieldCurve::GetFitNumber() const
+{
+    return fitNumber;
+}
+
+BondCurveService::BondCurveService(BondAnalytics &_analytics, const vector<string> &cusips, long _refitInterval) :
+analytics(_analytics), years(cusips.size(), 0), yields(cusips.size(), 0), priced(cusips.size(), 0), priced_count(0),
+stale(false), throttled(0), refit_interval(_refitInterval), since_fit(_refitInterval)
+{
+    for (size_t i = 0; i < cusips.size(); ++i) point_index[cusips[i]] = i;
+}
+
+void BondCurveService::ProcessAdd(Price<Bond> &price)
+{
+    const Bond &bond = price.GetProduct();
+    auto iter = point_index.find(bond.GetProductId());
+    if (iter == point_index.end()) return;
+    size_t point = iter->second;
+    long slot = analytics.FindBond(bond.GetProductId());
+    if (slot < 0) return;
+    yields[point] = analytics.GetYield(slot);
+    if (!priced[point])
+    {
+        priced[point] = 1;
+        ++priced_count;
+        years[point] = (bond.GetMaturityDate() - analytics.GetSettlement()).days() / DAYS_PER_YEAR;
+    }
+    stale = true;
+    if (++since_fit >= refit_interval) Refit();
+    else ++throttled;
+}
+
+void BondCurveService::AddListener(ServiceListener<YieldCurve> *listener)
+{
+    listener_list.push_back(listener);
+}
+
+//least squares for level, slope and curvature at a decay; returns the sum of squared errors
+double BondCurveService::Fit(double decay, double beta[3]) const
+{
+    double normal[3][4] = {};
+    for (size_t i = 0; i < years.size(); ++i)
+    {
+        if (!priced[i]) continue;
+        double x = years[i] / decay;
+        double e = exp(-x);
+        double f1 = x > 1e-8 ? (1 - e) / x : 1;
+        double row[3] = { 1, f1, f1 - e };
+        for (int r = 0; r < 3; ++r)
+        {
+            for (int c = 0; c < 3; ++c) normal[r][c] += row[r] * row[c];
+            normal[r][3] += row[r] * yields[i];
+        }
+    }
+    //Gaussian elimination with partial pivoting on the 3x4 augmented system
+    for (int c = 0; c < 3; ++c)
+    {
+        int pivot = c;
+        for (int r = c + 1; r < 3; ++r) if (fabs(normal[r][c]) > fabs(normal[pivot][c])) pivot = r;
+        for (int k = 0; k < 4; ++k) swap(normal[c][k], normal[pivot][k]);
+        if (fabs(normal[c][c]) < 1e-14) return HUGE_VAL;
+        for (int r = c + 1; r < 3; ++r)
+        {
+            double m = normal[r][c] / normal[c][c];
+            for (int k = c; k < 4; ++k) normal[r][k] -= m * normal[c][k];
+        }
+    }
+    for (int r = 2; r >= 0; --r)
+    {
+        double sum = normal[r][3];
+        for (int k = r + 1; k < 3; ++k) sum -= normal[r][k] * beta[k];
+        beta[r] = sum / normal[r][r];
+    }
+    double sse = 0;
+    for (size_t i = 0; i < years.size(); ++i)
+    {
+        if (!priced[i]) continue;
+        double x = years[i] / decay;
+        double e = exp(-x);
+        double f1 = x > 1e-8 ? (1 - e) / x : 1;
+        double error = beta[0] + beta[1] * f1 + beta[2] * (f1 - e) - yields[i];
+        sse += error * error;
+    }
+    return sse;
+}
+
+//Newton on the log decay with central differences, clipped to the search range
+void BondCurveService::Refit()
+{
+    if (priced_count < 4) return;
+    const double h = 1e-3;
+    double beta[3];
+    double log_decay = log(curve.GetDecay());
+    for (int iteration = 0; iteration < CURVE_MAX_ITERATIONS; ++iteration)
+    {
+        double f0 = Fit(exp(log_decay), beta);
+        double up = Fit(exp(log_decay + h), beta);
+        double down = Fit(exp(log_decay - h), beta);
+        double gradient = (up - down) / (2 * h);
+        double curvature = (up - 2 * f0 + down) / (h * h);
+        double step = curvature > 0 ? -gradient / curvature : (gradient > 0 ? -0.1 : 0.1);
+        if (step > 0.5) step = 0.5;
+        if (step < -0.5) step = -0.5;
+        double next = log_decay + step;
+        if (next < log(CURVE_MIN_DECAY)) next = log(CURVE_MIN_DECAY);
+        if (next > log(CURVE_MAX_DECAY)) next = log(CURVE_MAX_DECAY);
+        step = next - log_decay;
+        log_decay = next;
+        if (fabs(step) < CURVE_TOLERANCE) break;
+    }
+    double decay = exp(log_decay);
+    double sse = Fit(decay, beta);
+    curve = YieldCurve(beta[0], beta[1], beta[2], decay, sqrt(sse / priced_count), curve.GetFitNumber() + 1);
+    stale = false;
+    since_fit = 0;
+    for (size_t i = 0; i < listener_list.size(); ++i) listener_list[i]->ProcessAdd(curve);
+}
+
+void BondCurveService::Flush()
+{
+    if (stale) Refit();
+}
+
+const YieldCurve& BondCurveService::GetCurve() const
+{
+    return curve;
+}
+
+long BondCurveService::GetThrottledCount() const
+{
+    return throttled;
+}
+
+#endif
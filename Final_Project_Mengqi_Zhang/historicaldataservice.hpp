@@ -9,453 +9,423 @@
  */
 #ifndef HISTORICAL_DATA_SERVICE_HPP
 #define HISTORICAL_DATA_SERVICE_HPP
+#include <unordered_map>
 #include "positionservice.hpp"
+#include "riskservice.hpp"
 #include "executionservice.hpp"
+#include "streamingservice.hpp"
+#include "inquiryservice.hpp"
+#include "pnlservice.hpp"
+#include "spreadservice.hpp"
+#include "recordformatter.hpp"
+#include "historicalfile.hpp"
+
+// Outputs a historical data connector can write, combined as bit flags
+enum HistoricalOutput { TEXT_OUTPUT = 1, COMPRESSED_OUTPUT = 2, BINARY_OUTPUT = 4, INDEX_OUTPUT = 8 };
+
+//constant string tables for the enums, indexed by the enum value
+const char* const PRICING_SIDE_NAMES[] = { "BID", "OFFER" };
+const char* const ORDER_TYPE_NAMES[] = { "FOK", "IOC", "MARKET", "LIMIT", "STOP" };
+const char* const SIDE_NAMES[] = { "BUY", "SELL" };
+const char* const STATE_NAMES[] = { "RECEIVED", "QUOTED", "DONE", "REJECTED", "CUSTOMER_REJECTED" };
+const char* const BOOL_NAMES[] = { "FALSE", "TRUE" };
+const char* const RISK_RECORD_NAMES[] = { "DELTA", "CHECKPOINT" };
 
-//convert PricingSide to string
-string PricingSideOutput(PricingSide side);
+/**
+ * Column values that need more than their C++ type to be formatted.
+ * Schemas wrap their values in these so that the text and binary writers know what to do.
+ */
+// a double printed in fixed notation
+struct FixedValue { double value; };
+// a double printed in the default notation
+struct GeneralValue { double value; };
+// a bond price printed in fractional notation
+struct PriceValue { double value; };
+// an enum printed through its string table
+struct EnumValue { int value; const char* const *names; };
+
+inline FixedValue Fixed(double value) { FixedValue v = { value }; return v; }
+inline GeneralValue General(double value) { GeneralValue v = { value }; return v; }
+inline PriceValue Fractional(double value) { PriceValue v = { value }; return v; }
+inline EnumValue Enum(int value, const char* const *names) { EnumValue v = { value, names }; return v; }
 
-//convert OrderType to string
-string OrderTypeOutput(OrderType type);
+/**
+ * Writes the column names of a schema as the text header.
+ */
+class HistoricalHeaderWriter
+{
+  RecordBuffer &record;
+public:
+  HistoricalHeaderWriter(RecordBuffer &_record) : record(_record) {}
+  template<int Width, typename V> void Column(const char *name, const V &value) { record.Put<Width>(name); }
+};
+
+/**
+ * Writes the column values of a schema as one fixed-width text row.
+ */
+class HistoricalRowWriter
+{
+  RecordBuffer &record;
+public:
+  HistoricalRowWriter(RecordBuffer &_record) : record(_record) {}
+  template<int Width> void Column(const char *name, const string &value) { record.Put<Width>(value); }
+  template<int Width> void Column(const char *name, long value) { record.Put<Width>(value); }
+  template<int Width> void Column(const char *name, const date &value) { record.PutDate<Width>(value); }
+  template<int Width> void Column(const char *name, FixedValue value) { record.PutFixed<Width>(value.value); }
+  template<int Width> void Column(const char *name, GeneralValue value) { record.PutGeneral<Width>(value.value); }
+  template<int Width> void Column(const char *name, PriceValue value) { record.PutFractional<Width>(value.value); }
+  template<int Width> void Column(const char *name, EnumValue value) { record.Put<Width>(value.names[value.value]); }
+};
+
+/**
+ * Writes the column values of a schema as one binary record.
+ * Integers and doubles take 8 bytes, dates 4 bytes (day number), enums 1 byte and
+ * strings a 2-byte length followed by the characters, all little-endian.
+ */
+class HistoricalBinaryWriter
+{
+  vector<char> &out;
+  void Bytes(uint64_t value, int count) { for (int i = 0; i < count; ++i) out.push_back(char((value >> (8 * i)) & 0xff)); }
+  void Double(double value) { uint64_t bits; memcpy(&bits, &value, 8); Bytes(bits, 8); }
+public:
+  HistoricalBinaryWriter(vector<char> &_out) : out(_out) {}
+  template<int Width> void Column(const char *name, const string &value) { Bytes(value.size(), 2); out.insert(out.end(), value.begin(), value.end()); }
+  template<int Width> void Column(const char *name, long value) { Bytes(uint64_t(value), 8); }
+  template<int Width> void Column(const char *name, const date &value) { Bytes(uint32_t(value.day_number()), 4); }
+  template<int Width> void Column(const char *name, FixedValue value) { Double(value.value); }
+  template<int Width> void Column(const char *name, GeneralValue value) { Double(value.value); }
+  template<int Width> void Column(const char *name, PriceValue value) { Double(value.value); }
+  template<int Width> void Column(const char *name, EnumValue value) { Bytes(uint8_t(value.value), 1); }
+};
 
-//convert Side to string
-string SideOutput(Side side);
+/**
+ * Connector persisting one data type to its historical files.
+ * The layout comes from Schema, which must provide
+ *   static const char* Name();                                   // base name of the files
+ *   template<typename Visitor> static void Columns(Visitor&, const T&);  // one Column<Width>(name, value) per column
+ * From that single declaration the connector writes <Name>.txt (optionally block compressed),
+ * <Name>.bin and, with INDEX_OUTPUT, an index <Name>.idx for offline readers with one line
+ * "key text_offset binary_offset" per record, where the offsets are those of the record in
+ * the uncompressed text and in the binary file. Index lines are written as the records
+ * are, so nothing grows with the number of records.
+ * Type T is the data type to persist.
+ */
+template<typename T, typename Schema>
+class HistoricalDataConnector : public Connector<T>
+{
+private:
+    int outputs;//HistoricalOutput flags
+    long count;//number of records persisted
+    HistoricalFile text_file;
+    ofstream binary_file;
+    uint64_t binary_offset;
+    RecordBuffer record;//row being formatted
+    vector<char> binary_record;//binary row being serialized
+    ofstream index_file;
+    RecordBuffer index_record;//index line being formatted
+
+    HistoricalDataConnector(const HistoricalDataConnector&);
+    HistoricalDataConnector& operator=(const HistoricalDataConnector&);
+    void Open(const T& first);
+public:
+    HistoricalDataConnector(int _outputs = TEXT_OUTPUT);
+    ~HistoricalDataConnector();
 
-//convert InquiryState to string
-string StateOutput(InquiryState state);
+    //persist data under the next sequential key
+    void Publish(T& data) override;
 
-//return bucket sectors giving its CUSIP
-string BondExpity(string cusip);
+    //persist data under the given key
+    void Persist(const string& persistKey, T& data);
 
-ofstream f1;
-ofstream f2;
+    //flush and close the output files
+    void Close();
+};
 
 /**
  * Service for processing and persisting historical data to a persistent store.
  * Keyed on some persistent key.
- * Type T is the data type to persist.
+ * Type T is the data type to persist, Schema describes its columns (see HistoricalDataConnector).
  */
-template<typename T>
+template<typename T, typename Schema>
 class HistoricalDataService : public virtual Service<string,T>
 {
-    
+private:
+    long num;//key; keep track of the number of output
+    HistoricalDataConnector<T, Schema>& conn;
 public:
-    
-    // Persist data to a store
-    virtual void PersistData(string persistKey, T& data) = 0;
-    
-};
+    HistoricalDataService(HistoricalDataConnector<T, Schema>& _input) : num(1), conn(_input) {}
 
-string PricingSideOutput(PricingSide side)
-{
-    if (side == BID)
-        return "BID";
-    else return "OFFER";
-}
+    //the objects the class received are persisted back into txt files through connector
+    //no stored listeners
+    T& GetData(string key) override {exit(-1);}
+    void AddListener(ServiceListener<T>* listener) override {}
+    const vector<ServiceListener<T>*>& GetListeners() const override {exit(-1);}
 
-string OrderTypeOutput(OrderType type)
-{
-    if (type == FOK)
-        return "FOK";
-    else if (type == IOC)
-        return "IOC";
-    else if (type == MARKET)
-        return "MARKET";
-    else if (type == LIMIT)
-        return "LIMIT";
-    else return "STOP";
-}
+    void OnMessage(T& data) override;
 
-string SideOutput(Side side)
+    // Persist data to a store
+    void PersistData(string persistKey, T& data);
+};
+
+//Definition of HistoricalDataConnector class
+template<typename T, typename Schema>
+HistoricalDataConnector<T, Schema>::HistoricalDataConnector(int _outputs) : outputs(_outputs), count(0), binary_offset(0)
 {
-    if (side == BUY)
-        return "BUY";
-    else return "SELL";
 }
 
-string StateOutput(InquiryState state)
+template<typename T, typename Schema>
+HistoricalDataConnector<T, Schema>::~HistoricalDataConnector()
 {
-    if (state == RECEIVED)
-        return "RECEIVED";
-    else if (state == QUOTED)
-        return "QUOTED";
-    else if (state == DONE)
-        return "DONE";
-    else if (state == REJECTED)
-        return "REJECTED";
-    else return "CUSTOMER_REJECTED";
+    Close();
 }
 
-string BondExpiry(string cusip)
+//files are created on the first record, so that unused connectors leave nothing behind
+template<typename T, typename Schema>
+void HistoricalDataConnector<T, Schema>::Open(const T& first)
 {
-    if (cusip == "912828M72" || cusip == "912828N22" || cusip == "912828M98")
+    string name = Schema::Name();
+    if (outputs & TEXT_OUTPUT)
     {
-        return "FrontEnd";
+        text_file.Open(name + ".txt", (outputs & COMPRESSED_OUTPUT) != 0);
+        HistoricalHeaderWriter header(record);
+        record.Put<5>("Key");
+        Schema::Columns(header, first);
+        record.EndLine();
+        text_file.Write(record);
     }
-    else if (cusip == "912828M80" || cusip == "912828M56")
+    if (outputs & BINARY_OUTPUT)
     {
-        return "Belly";
+        binary_file.open(name + ".bin", ios::binary);
     }
-    else if (cusip == "912810RP5")
+    if (outputs & INDEX_OUTPUT)
     {
-        return "LongEnd";
+        index_file.open(name + ".idx", ios::binary);
     }
-    return "Other";
 }
 
-
-class BondHistoricalPositionDataConnector : public Connector< Position<Bond> >
+template<typename T, typename Schema>
+void HistoricalDataConnector<T, Schema>::Publish(T& data)
 {
-public:
-    void Publish(Position<Bond>& data);
-};
+    Persist(to_string(count + 1), data);
+}
 
-class BondHistoricalPositionDataService : public HistoricalDataService< Position<Bond> >
+template<typename T, typename Schema>
+void HistoricalDataConnector<T, Schema>::Persist(const string& persistKey, T& data)
 {
-    int num;//key; keep track of the number of output
-    BondHistoricalPositionDataConnector conn;
-public:
-    //constructors
-    BondHistoricalPositionDataService():num(1){}
-    BondHistoricalPositionDataService(BondHistoricalPositionDataConnector _input) : conn(_input), num(1){}
-    
-    //the objects the class received are persisted back into txt files through connector
-    //no stored listeners
-    Position<Bond>& GetData(string key) override {exit(-1);}
-    void AddListener(ServiceListener< Position<Bond> >* listener) override {}
-    const vector< ServiceListener< Position<Bond> >*>& GetListeners() const override {exit(-1);}
-    
-    void OnMessage(Position<Bond>& data) override;
-    void PersistData(string persistKey, Position<Bond>& data) override;
-};
+    if (count++ == 0) Open(data);
 
-void BondHistoricalPositionDataService::OnMessage(Position<Bond> &data)
-{
-    string persistKey = to_string(num);
-    this->PersistData(persistKey, data);
-}
+    //the index line holds the key, text offset and binary offset of the record
+    if (outputs & INDEX_OUTPUT)
+    {
+        index_record.Put<0>(persistKey);
+        index_record.Put<0>(" ");
+        index_record.Put<0>(long(text_file.GetOffset()));
+        index_record.Put<0>(" ");
+        index_record.Put<0>(long(binary_offset));
+        index_record.EndLine();
+        index_file.write(index_record.GetData(), index_record.GetSize());
+        index_record.Clear();
+    }
 
-void BondHistoricalPositionDataService::PersistData(string persistKey, Position<Bond>& data)
-{
-    if (num == 1)
+    if (outputs & TEXT_OUTPUT)
+    {
+        HistoricalRowWriter row(record);
+        record.Put<5>(persistKey);
+        Schema::Columns(row, data);
+        record.EndLine();
+        text_file.Write(record);
+    }
+    if (outputs & BINARY_OUTPUT)
     {
-        f2.close();
-        f2.open("position.txt");
-        f2 << setw(5) << "Key"
-        << setw(13) << "productID"
-        << setw(10) << "Coupon"
-        << setw(15) << "Maturity Date"
-        << setw(20) << "Aggregate Position"
-        << setw(10) << "TRSY1"
-        << setw(10) << "TRSY2"
-        << setw(10) <<  "TRSY3"
-        << endl;
+        //every binary record is prefixed with its length so the file can be walked without the index
+        binary_record.assign(4, 0);
+        HistoricalBinaryWriter binary(binary_record);
+        binary.Column<0>("Key", persistKey);
+        Schema::Columns(binary, data);
+        PutU32(&binary_record[0], uint32_t(binary_record.size() - 4));
+        binary_file.write(binary_record.data(), binary_record.size());
+        binary_offset += binary_record.size();
     }
-    f2 << setw(5) << persistKey;
-    num++;
-    conn.Publish(data);
 }
 
-void BondHistoricalPositionDataConnector::Publish(Position<Bond>& data)
+template<typename T, typename Schema>
+void HistoricalDataConnector<T, Schema>::Close()
 {
-    vector<string> book = {"TRSY1", "TRSY2", "TRSY3"};
-    f2 << setw(13) << data.GetProduct().GetProductId()
-    << setw(10) << data.GetProduct().GetCoupon()
-    << "    " << data.GetProduct().GetMaturityDate()
-    << setw(20) << data.GetAggregatePosition()
-    << setw(10) << data.GetPosition(book[0])
-    << setw(10) << data.GetPosition(book[1])
-    << setw(10) << data.GetPosition(book[2])
-    << endl;
+    if (count == 0) return;
+    text_file.Close();
+    binary_file.close();
+    index_file.close();
+    count = 0;
 }
 
-
-class BondHistoricalRiskDataConnector : public Connector< vector< PV01<Bond> > >
-{
-public:
-    void Publish(vector< PV01<Bond> >& data);
-};
-
-class BondHistoricalRiskDataService : public HistoricalDataService< vector< PV01<Bond> > >
-{
-    int num;//key number
-    BondHistoricalRiskDataConnector conn;
-public:
-    //constructors
-    BondHistoricalRiskDataService():num(1){}
-    BondHistoricalRiskDataService(BondHistoricalRiskDataConnector _input) : conn(_input), num(1){}
-    
-    //the objects the class received are persisted back into txt files through connector
-    //no stored listeners
-    vector<PV01<Bond>>& GetData(string key) override {exit(-1);}
-    void AddListener(ServiceListener<vector<PV01<Bond>>>* listener) override {}
-    const vector<ServiceListener<vector<PV01<Bond>>>*>& GetListeners() const override {exit(-1);}
-    
-    void OnMessage(vector<PV01<Bond>>& data);
-    void PersistData(string persistKey, vector<PV01<Bond>>& data);
-};
-    
-void BondHistoricalRiskDataService::OnMessage(vector< PV01<Bond> >& data)
+//Definition of HistoricalDataService class
+template<typename T, typename Schema>
+void HistoricalDataService<T, Schema>::OnMessage(T& data)
 {
     string persistKey = to_string(num);
     this->PersistData(persistKey, data);
 }
 
-void BondHistoricalRiskDataService::PersistData(string persistKey, vector< PV01<Bond> >& data)
+template<typename T, typename Schema>
+void HistoricalDataService<T, Schema>::PersistData(string persistKey, T& data)
 {
-    if (num == 1)
-    {
-        f1.close();
-        f1.open("risk.txt");
-        f1 << setw(5) << "Key"
-        << setw(20) << "FrontEnd Risk"
-        << setw(20) << "Belly Risk"
-        << setw(20) << "LongEnd Risk"
-        << "    " << "ProductID    Coupon      Maturity Date  Total Risk"
-        << endl;
-    }
-    f1 << setw(5) << persistKey;
     ++num;
-    conn.Publish(data);
+    conn.Persist(persistKey, data);
 }
 
-void BondHistoricalRiskDataConnector::Publish(vector< PV01<Bond> >& data)
+
+/**
+ * Schemas of the persisted types.
+ * Each column is declared once as Column<Width>(name, value); the width is the setw of the text file.
+ */
+struct PositionSchema
 {
-    double front_end_risk(0.0), belly_risk(0.0), long_end_risk(0.0);
-    
-    for (long i = 0; i < data.size(); i++)
-    {
-        if (BondExpiry(data[i].GetProduct().GetProductId()) == "FrontEnd")
-        {
-            front_end_risk += data[i].GetQuantity() * data[i].GetPV01();
-        }
-        else if (BondExpiry(data[i].GetProduct().GetProductId()) == "Belly")
-        {
-            belly_risk += data[i].GetQuantity() * data[i].GetPV01();
-        }
-        else if (BondExpiry(data[i].GetProduct().GetProductId()) == "LongEnd")
-        {
-            long_end_risk += data[i].GetQuantity() * data[i].GetPV01();
-        }
-    }
-    
-    f1 << fixed
-    << setw(20) << front_end_risk
-    << setw(20) << belly_risk
-    << setw(20) << long_end_risk;
-    
-    for (long i = 0; i < data.size(); i++)
+    static const char* Name() { return "position"; }
+
+    template<typename Visitor>
+    static void Columns(Visitor& v, const Position<Bond>& data)
     {
-        if (i == 0)
-        {
-            f1 << "    ";
-        }
-        else
-        {
-            f1 << setw(78);
-        }
-        f1 << fixed  << data[i].GetProduct().GetProductId()
-        << "    " << data[i].GetProduct().GetCoupon()
-        << "    " << data[i].GetProduct().GetMaturityDate()
-        << "    " <<  data[i].GetQuantity() * data[i].GetPV01()
-        << endl;
+        static string book[] = {"TRSY1", "TRSY2", "TRSY3"};
+        v.template Column<13>("productID", data.GetProduct().GetProductId());
+        v.template Column<10>("Coupon", General(data.GetProduct().GetCoupon()));
+        v.template Column<15>("Maturity Date", data.GetProduct().GetMaturityDate());
+        v.template Column<20>("Aggregate Position", data.GetAggregatePosition());
+        v.template Column<10>("TRSY1", data.GetPosition(book[0]));
+        v.template Column<10>("TRSY2", data.GetPosition(book[1]));
+        v.template Column<10>("TRSY3", data.GetPosition(book[2]));
     }
-    
-}
-
-
-class BondHistoricalExecutionDataConnector : public Connector< ExecutionOrder<Bond> >
-{
-public:
-    void Publish(ExecutionOrder<Bond>& data);
 };
 
-class BondHistoricalExecutionDataService : public HistoricalDataService< ExecutionOrder<Bond> >
+//every row is either the delta of one product or one product of a full checkpoint;
+//the latest state is the last checkpoint with the later deltas applied on top
+struct RiskSchema
 {
-    int num;//Key number
-    BondHistoricalExecutionDataConnector conn;
+    static const char* Name() { return "risk"; }
 
-public:
-    //constructors
-    BondHistoricalExecutionDataService():num(1){}
-    BondHistoricalExecutionDataService(BondHistoricalExecutionDataConnector _input) : conn(_input), num(1){}
-    
-    //the objects the class received are persisted back into txt files through connector
-    //no stored listeners
-    ExecutionOrder<Bond>& GetData(string key) override {exit(-1);}
-    void AddListener(ServiceListener< ExecutionOrder<Bond> >* listener) override {}
-    const vector< ServiceListener< ExecutionOrder<Bond> >*>& GetListeners() const override {exit(-1);}
-
-    void OnMessage(ExecutionOrder<Bond>& data);
-    void PersistData(string persistKey, ExecutionOrder<Bond>& data);
+    template<typename Visitor>
+    static void Columns(Visitor& v, const RiskUpdate<Bond>& data)
+    {
+        const PV01<Bond>& risk = data.GetRisk();
+        v.template Column<12>("Record", Enum(data.IsCheckpoint(), RISK_RECORD_NAMES));
+        v.template Column<20>("FrontEnd Risk", Fixed(data.GetBucketRisk(FRONTEND)));
+        v.template Column<20>("Belly Risk", Fixed(data.GetBucketRisk(BELLY)));
+        v.template Column<20>("LongEnd Risk", Fixed(data.GetBucketRisk(LONGEND)));
+        v.template Column<13>("ProductID", risk.GetProduct().GetProductId());
+        v.template Column<12>("Coupon", Fixed(risk.GetProduct().GetCoupon()));
+        v.template Column<15>("Maturity Date", risk.GetProduct().GetMaturityDate());
+        v.template Column<20>("Total Risk", Fixed(risk.GetQuantity() * risk.GetPV01()));
+    }
 };
 
-void BondHistoricalExecutionDataService::OnMessage(ExecutionOrder<Bond> &data)
+struct ExecutionSchema
 {
-    string persistKey = to_string(num);
-    this->PersistData(persistKey, data);
-}
+    static const char* Name() { return "executions"; }
 
-void BondHistoricalExecutionDataService::PersistData(string persistKey, ExecutionOrder<Bond>& data)
-{
-    if (num == 1)
+    template<typename Visitor>
+    static void Columns(Visitor& v, const ExecutionOrder<Bond>& data)
     {
-        f1.close();
-        f1.open("executions.txt");
-        f1 << setw(5) << "Key"
-        << setw(15) << "ProductID"
-        << setw(10) << "Side"
-        << setw(10) << "OrderID"
-        << setw(13) << "OrderType"
-        << setw(10) << "Price"
-        << setw(18) << "VisibleQuantity"
-        << setw(18) << "HiddenQuantity"
-        << setw(18) << "ParentOrderID"
-        << setw(15) << "IsChildOrder"
-        << endl;
+        v.template Column<15>("ProductID", data.GetProduct().GetProductId());
+        v.template Column<10>("Side", Enum(data.GetSide(), PRICING_SIDE_NAMES));
+        v.template Column<10>("OrderID", data.GetOrderId());
+        v.template Column<13>("OrderType", Enum(data.GetOrderType(), ORDER_TYPE_NAMES));
+        v.template Column<10>("Price", Fractional(data.GetPrice()));
+        v.template Column<18>("VisibleQuantity", data.GetVisibleQuantity());
+        v.template Column<18>("HiddenQuantity", data.GetHiddenQuantity());
+        v.template Column<18>("ParentOrderID", data.GetParentOrderId());
+        v.template Column<15>("IsChildOrder", Enum(data.IsChildOrder(), BOOL_NAMES));
     }
-    
-    f1 << setw(5) << persistKey;
-    ++num;
-    conn.Publish(data);
-}
-
-void BondHistoricalExecutionDataConnector::Publish(ExecutionOrder<Bond>& data)
-{
-    f1 << setw(15) << data.GetProduct().GetProductId()
-    << setw(10) << PricingSideOutput(data.GetSide())
-    << setw(10) << data.GetOrderId()
-    << setw(13) << OrderTypeOutput(data.GetOrderType())
-    << setw(10) << FractionalBondPrice(data.GetPrice())
-    << setw(18) << data.GetVisibleQuantity()
-    << setw(18) << data.GetHiddenQuantity()
-    << setw(18) << data.GetParentOrderId()
-    << setw(15) << "FALSE"
-    << endl;
-}
-
-
-class BondHistoricalStreamingDataConnector : public Connector<PriceStream<Bond>>
-{
-public:
-    void Publish(PriceStream<Bond>& data);
 };
 
-class BondHistoricalStreamingDataService : public HistoricalDataService< PriceStream<Bond> >
+struct StreamingSchema
 {
-    int num;//Key number
-    BondHistoricalStreamingDataConnector conn;
-public:
-    //ctor
-    BondHistoricalStreamingDataService(): num(1){}
-    BondHistoricalStreamingDataService(BondHistoricalStreamingDataConnector _input) : conn(_input),num(1){}
-    
-    //the objects the class received are persisted back into txt files through connector
-    //no stored listeners
-    PriceStream<Bond>& GetData(string key) override {exit(-1);}
-    void AddListener(ServiceListener< PriceStream<Bond> >* listener) override {}
-    const vector< ServiceListener< PriceStream<Bond> >*>& GetListeners() const override {exit(-1);}
+    static const char* Name() { return "streaming"; }
 
-    void OnMessage(PriceStream<Bond>& data);
-    void PersistData(string persistKey, PriceStream<Bond>& data);
+    template<typename Visitor>
+    static void Columns(Visitor& v, const PriceStream<Bond>& data)
+    {
+        v.template Column<15>("ProductID", data.GetProduct().GetProductId());
+        v.template Column<15>("Bid Price", Fractional(data.GetBidOrder().GetPrice()));
+        v.template Column<15>("Quantity", data.GetBidOrder().GetVisibleQuantity());
+        v.template Column<15>("Offer Price", Fractional(data.GetOfferOrder().GetPrice()));
+        v.template Column<15>("Quantity", data.GetOfferOrder().GetVisibleQuantity());
+    }
 };
 
-void BondHistoricalStreamingDataService::OnMessage(PriceStream<Bond> &data)
+struct InquirySchema
 {
-    string persistKey = to_string(num);
-    this->PersistData(persistKey, data);
-}
+    static const char* Name() { return "allinquires"; }
 
-void BondHistoricalStreamingDataService::PersistData(string persistKey, PriceStream<Bond>& data)
-{
-    if (num == 1)
+    template<typename Visitor>
+    static void Columns(Visitor& v, const Inquiry<Bond>& data)
     {
-        f1.close();
-        f1.open("streaming.txt");
-        f1 << setw(5) << "Key"
-        << setw(15) << "ProductID"
-        << setw(15) << "Bid Price"
-        << setw(15) << "Quantity"
-        << setw(15) << "Offer Price"
-        << setw(15) << "Quantity"
-        << endl;
+        v.template Column<13>("InquiryID", data.GetInquiryId());
+        v.template Column<15>("ProductID", data.GetProduct().GetProductId());
+        v.template Column<10>("Side", Enum(data.GetSide(), SIDE_NAMES));
+        v.template Column<15>("Quantity", data.GetQuantity());
+        v.template Column<15>("Price", Fractional(data.GetPrice()));
+        v.template Column<10>("State", Enum(data.GetState(), STATE_NAMES));
     }
-    f1 << setw(5) << persistKey;
-    ++num;
-    conn.Publish(data);
-}
+};
 
-void BondHistoricalStreamingDataConnector::Publish(PriceStream<Bond>& data)
+//one row per change of a product: its mark and P&L after the change
+struct PnLSchema
 {
-    f1 << setw(15) << data.GetProduct().GetProductId()
-    << setw(15) << FractionalBondPrice(data.GetBidOrder().GetPrice())
-    << setw(15) << data.GetBidOrder().GetVisibleQuantity()
-    << setw(15) << FractionalBondPrice(data.GetOfferOrder().GetPrice())
-    << setw(15) << data.GetOfferOrder().GetVisibleQuantity()
-    << endl;
-}
+    static const char* Name() { return "pnl"; }
 
+    //books are looked up by name, like the position columns
+    static double BookPnL(const PnL<Bond>& data, const string& book)
+    {
+        int id = FindBook(book);
+        return id < 0 ? 0 : data.GetRealized(id) + data.GetUnrealized(id);
+    }
 
-class BondHistoricalInquiryDataConnector : public Connector< Inquiry<Bond> >
-{
-public:
-    void Publish(Inquiry<Bond>& data);
+    template<typename Visitor>
+    static void Columns(Visitor& v, const PnL<Bond>& data)
+    {
+        static string book[] = {"TRSY1", "TRSY2", "TRSY3"};
+        v.template Column<13>("ProductID", data.GetProduct().GetProductId());
+        v.template Column<12>("Mark", Fixed(data.GetMark()));
+        v.template Column<20>("Realized", Fixed(data.GetRealized()));
+        v.template Column<20>("Unrealized", Fixed(data.GetUnrealized()));
+        v.template Column<20>("TRSY1", Fixed(BookPnL(data, book[0])));
+        v.template Column<20>("TRSY2", Fixed(BookPnL(data, book[1])));
+        v.template Column<20>("TRSY3", Fixed(BookPnL(data, book[2])));
+    }
 };
 
-class BondHistoricalInquiryDataService : public HistoricalDataService< Inquiry<Bond> >
+//one row per change of a spread
+struct SpreadSchema
 {
-    int num;//key number
-    BondHistoricalInquiryDataConnector conn;
-public:
-    //constructors
-    BondHistoricalInquiryDataService():num(1){}
-    BondHistoricalInquiryDataService(BondHistoricalInquiryDataConnector _input) : conn(_input), num(1){}
+    static const char* Name() { return "curvespreads"; }
 
-    //the objects the class received are persisted back into txt files through connector
-    //no stored listeners
-    Inquiry<Bond>& GetData(string key) override {exit(-1);}
-    void AddListener(ServiceListener< Inquiry<Bond> >* listener) override {}
-    const vector< ServiceListener< Inquiry<Bond> >*>& GetListeners() const override {exit(-1);}
-    
-    void OnMessage(Inquiry<Bond>& data);
-    void PersistData(string persistKey, Inquiry<Bond>& data);
+    template<typename Visitor>
+    static void Columns(Visitor& v, const Spread<Bond>& data)
+    {
+        v.template Column<12>("Spread", data.GetName());
+        v.template Column<20>("Yield Spread (bp)", Fixed(data.GetYieldSpread()));
+        v.template Column<20>("Price Spread", Fixed(data.GetPriceSpread()));
+    }
 };
 
-void BondHistoricalInquiryDataService::OnMessage(Inquiry<Bond>& data)
-{
-    string persistKey = to_string(num);
-    this->PersistData(persistKey, data);
-}
+typedef HistoricalDataConnector<Position<Bond>, PositionSchema> BondHistoricalPositionDataConnector;
+typedef HistoricalDataService<Position<Bond>, PositionSchema> BondHistoricalPositionDataService;
 
-void BondHistoricalInquiryDataService::PersistData(string persistKey, Inquiry<Bond>& data)
-{
-    if (num == 1)
-    {
-        f1.close();
-        f1.open("allinquires.txt");
-        f1 << setw(5) << "Key"
-        << setw(13) << "InquiryID"
-        << setw(15) << "ProductID"
-        << setw(10) << "Side"
-        << setw(15) << "Quantity"
-        << setw(15) << "Price"
-        << setw(10) << "State"
-        << endl;
-    }
-    f1 << setw(5) << persistKey;
-    ++num;
-    conn.Publish(data);
-}
+typedef HistoricalDataConnector<RiskUpdate<Bond>, RiskSchema> BondHistoricalRiskDataConnector;
+typedef HistoricalDataService<RiskUpdate<Bond>, RiskSchema> BondHistoricalRiskDataService;
 
-void BondHistoricalInquiryDataConnector::Publish(Inquiry<Bond>& data)
-{
-    f1 << setw(13) << data.GetInquiryId()
-    << setw(15) << data.GetProduct().GetProductId()
-    << setw(10) << SideOutput(data.GetSide())
-    << setw(15) << data.GetQuantity()
-    << setw(15) << FractionalBondPrice(data.GetPrice())
-    << setw(10) << StateOutput(data.GetState())
-    << endl;
-}
+typedef HistoricalDataConnector<ExecutionOrder<Bond>, ExecutionSchema> BondHistoricalExecutionDataConnector;
+typedef HistoricalDataService<ExecutionOrder<Bond>, ExecutionSchema> BondHistoricalExecutionDataService;
+
+typedef HistoricalDataConnector<PriceStream<Bond>, StreamingSchema> BondHistoricalStreamingDataConnector;
+typedef HistoricalDataService<PriceStream<Bond>, StreamingSchema> BondHistoricalStreamingDataService;
+
+typedef HistoricalDataConnector<Inquiry<Bond>, InquirySchema> BondHistoricalInquiryDataConnector;
+typedef HistoricalDataService<Inquiry<Bond>, InquirySchema> BondHistoricalInquiryDataService;
+
+typedef HistoricalDataConnector<PnL<Bond>, PnLSchema> BondHistoricalPnLDataConnector;
+typedef HistoricalDataService<PnL<Bond>, PnLSchema> BondHistoricalPnLDataService;
+
+typedef HistoricalDataConnector<Spread<Bond>, SpreadSchema> BondHistoricalSpreadDataConnector;
+typedef HistoricalDataService<Spread<Bond>, SpreadSchema> BondHistoricalSpreadDataService;
 
 #endif
@@ -0,0 +1,463 @@
+/**
+ * historicalfile.hpp
+ * Output files of the historical data services, optionally block compressed.
+ *
+ * A plain file is written as is. A compressed file is written by a background thread:
+ * records are gathered into blocks of whole rows, each block is compressed on its own
+ * with blockcodec.hpp and a block index is appended when the file is closed.
+ *
+ * Compressed file layout (all integers little-endian):
+ *   "HDBZ"
+ *   blocks:  u32 raw size, u32 stored size, stored bytes (raw bytes when stored size == raw size)
+ *   index:   per block u64 file offset, u64 raw offset, u32 raw size, u32 stored size
+ *   footer:  u64 index offset, u32 block count, "HDBI"
+ */
+#ifndef HISTORICAL_FILE_HPP
+#define HISTORICAL_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "blockcodec.hpp"
+#include "recordformatter.hpp"
+
+using namespace std;
+
+// Raw size of a compressed block
+const size_t HISTORICAL_BLOCK_SIZE = 64 * 1024;
+
+// Suffix appended to the name of a compressed file
+const char* const COMPRESSED_FILE_SUFFIX = ".lz";
+
+const char COMPRESSED_FILE_MAGIC[4] = { 'H', 'D', 'B', 'Z' };
+const char COMPRESSED_INDEX_MAGIC[4] = { 'H', 'D', 'B', 'I' };
+
+/**
+ * Entry of the block index of a compressed file.
+ */
+struct BlockIndexEntry
+{
+  uint64_t fileOffset;
+  uint64_t rawOffset;
+  uint32_t rawSize;
+  uint32_t storedSize;
+};
+
+/**
+ * An output file of a historical data service.
+ * Records are written whole; in compressed mode they are handed to a background writer
+ * in blocks, so compression and disk writes stay off the publishing thread.
+ */
+class HistoricalFile
+{
+
+public:
+
+  // ctor for a closed file
+  HistoricalFile();
+  ~HistoricalFile();
+
+  // Open a file, compressed files get COMPRESSED_FILE_SUFFIX appended to their name
+  void Open(const string &path, bool compressed = false);
+
+  // Flush everything and close the file
+  void Close();
+
+  // Write one whole record
+  void Write(const char *data, size_t length);
+
+  // Write a formatted record and clear it
+  void Write(RecordBuffer &record);
+
+  bool IsOpen() const;
+
+  bool IsCompressed() const;
+
+  // Get the number of uncompressed bytes written so far
+  uint64_t GetOffset() const;
+
+private:
+  ofstream file;
+  bool compressed;
+  uint64_t written;
+
+  // block being filled by the publishing thread
+  vector<char> block;
+
+  // background writer state, guarded by lock
+  thread writer;
+  mutex lock;
+  condition_variable ready;
+  deque< vector<char> > pending;
+  vector< vector<char> > spare;
+  bool stopping;
+
+  // owned by the background writer
+  vector<BlockIndexEntry> index;
+  vector<char> scratch;
+  uint64_t fileOffset;
+  uint64_t rawOffset;
+
+  HistoricalFile(const HistoricalFile&);
+  HistoricalFile& operator=(const HistoricalFile&);
+
+  void SealBlock();
+  void WriterLoop();
+  void WriteBlock(const vector<char> &raw);
+  void WriteIndex();
+
+};
+
+/**
+ * Reader for historical files that handles plain and compressed files alike.
+ * A plain file is presented as consecutive blocks of HISTORICAL_BLOCK_SIZE bytes, which
+ * unlike compressed blocks may end in the middle of a row.
+ */
+class HistoricalFileReader
+{
+
+public:
+
+  // Open a file; when path itself does not exist, path + COMPRESSED_FILE_SUFFIX is tried
+  bool Open(const string &path);
+
+  bool IsCompressed() const;
+
+  // Get the number of independently decodable blocks
+  size_t GetBlockCount() const;
+
+  // Get the index entry of a block
+  const BlockIndexEntry& GetBlockEntry(size_t i) const;
+
+  // Decode a single block
+  bool ReadBlock(size_t i, string &output);
+
+  // Decode the whole file
+  bool ReadAll(string &output);
+
+private:
+  ifstream file;
+  bool compressed;
+  vector<BlockIndexEntry> index;
+
+};
+
+inline void PutU32(char *p, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) p[i] = char((value >> (8 * i)) & 0xff);
+}
+
+inline void PutU64(char *p, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) p[i] = char((value >> (8 * i)) & 0xff);
+}
+
+inline uint32_t GetU32(const char *p)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) value |= uint32_t((unsigned char)p[i]) << (8 * i);
+    return value;
+}
+
+inline uint64_t GetU64(const char *p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value |= uint64_t((unsigned char)p[i]) << (8 * i);
+    return value;
+}
+
+//Definition of HistoricalFile class
+HistoricalFile::HistoricalFile() : compressed(false), written(0), stopping(false), fileOffset(0), rawOffset(0)
+{
+}
+
+HistoricalFile::~HistoricalFile()
+{
+    Close();
+}
+
+void HistoricalFile::Open(const string &path, bool _compressed)
+{
+    Close();
+    compressed = _compressed;
+    written = 0;
+    if (!compressed)
+    {
+        file.open(path, ios::binary);
+        return;
+    }
+
+    file.open(path + COMPRESSED_FILE_SUFFIX, ios::binary);
+    if (!file.is_open())
+    {
+        cout << "File open failed: " << path << COMPRESSED_FILE_SUFFIX << endl;
+        return;
+    }
+    file.write(COMPRESSED_FILE_MAGIC, 4);
+    fileOffset = 4;
+    rawOffset = 0;
+    index.clear();
+    stopping = false;
+    block.reserve(HISTORICAL_BLOCK_SIZE);
+    writer = thread(&HistoricalFile::WriterLoop, this);
+}
+
+//the writer thread only runs for a compressed file that opened
+void HistoricalFile::Close()
+{
+    if (writer.joinable())
+    {
+        SealBlock();
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_one();
+        writer.join();
+        WriteIndex();
+    }
+    if (file.is_open()) file.close();
+}
+
+//records for a file that failed to open are dropped rather than queued without a writer
+void HistoricalFile::Write(const char *data, size_t length)
+{
+    if (!file.is_open()) return;
+    written += length;
+    if (!compressed)
+    {
+        file.write(data, length);
+        return;
+    }
+    // blocks hold whole records so that a decoded block is a run of complete rows
+    if (!block.empty() && block.size() + length > HISTORICAL_BLOCK_SIZE) SealBlock();
+    block.insert(block.end(), data, data + length);
+}
+
+void HistoricalFile::Write(RecordBuffer &record)
+{
+    Write(record.GetData(), record.GetSize());
+    record.Clear();
+}
+
+bool HistoricalFile::IsOpen() const
+{
+    return file.is_open();
+}
+
+bool HistoricalFile::IsCompressed() const
+{
+    return compressed;
+}
+
+uint64_t HistoricalFile::GetOffset() const
+{
+    return written;
+}
+
+//hand the current block to the background writer and continue with a recycled buffer
+void HistoricalFile::SealBlock()
+{
+    if (block.empty()) return;
+    vector<char> next;
+    {
+        lock_guard<mutex> guard(lock);
+        pending.push_back(vector<char>());
+        pending.back().swap(block);
+        if (!spare.empty())
+        {
+            next.swap(spare.back());
+            spare.pop_back();
+        }
+    }
+    ready.notify_one();
+    next.clear();
+    next.reserve(HISTORICAL_BLOCK_SIZE);
+    block.swap(next);
+}
+
+void HistoricalFile::WriterLoop()
+{
+    vector<char> raw;
+    while (true)
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            if (!raw.empty())
+            {
+                spare.push_back(vector<char>());
+                spare.back().swap(raw);
+            }
+            while (pending.empty() && !stopping) ready.wait(guard);
+            if (pending.empty()) return;
+            raw.swap(pending.front());
+            pending.pop_front();
+        }
+        WriteBlock(raw);
+    }
+}
+
+void HistoricalFile::WriteBlock(const vector<char> &raw)
+{
+    scratch.resize(LZCompressBound(raw.size()));
+    size_t stored_size = LZCompress(raw.data(), raw.size(), scratch.data());
+    const char *stored = scratch.data();
+    // incompressible blocks are stored raw
+    if (stored_size >= raw.size())
+    {
+        stored_size = raw.size();
+        stored = raw.data();
+    }
+
+    char header[8];
+    PutU32(header, uint32_t(raw.size()));
+    PutU32(header + 4, uint32_t(stored_size));
+    file.write(header, 8);
+    file.write(stored, stored_size);
+
+    BlockIndexEntry entry;
+    entry.fileOffset = fileOffset;
+    entry.rawOffset = rawOffset;
+    entry.rawSize = uint32_t(raw.size());
+    entry.storedSize = uint32_t(stored_size);
+    index.push_back(entry);
+    fileOffset += 8 + stored_size;
+    rawOffset += raw.size();
+}
+
+void HistoricalFile::WriteIndex()
+{
+    uint64_t index_offset = fileOffset;
+    char entry[24];
+    for (size_t i = 0; i < index.size(); ++i)
+    {
+        PutU64(entry, index[i].fileOffset);
+        PutU64(entry + 8, index[i].rawOffset);
+        PutU32(entry + 16, index[i].rawSize);
+        PutU32(entry + 20, index[i].storedSize);
+        file.write(entry, 24);
+    }
+    char footer[16];
+    PutU64(footer, index_offset);
+    PutU32(footer + 8, uint32_t(index.size()));
+    memcpy(footer + 12, COMPRESSED_INDEX_MAGIC, 4);
+    file.write(footer, 16);
+}
+
+//Definition of HistoricalFileReader class
+bool HistoricalFileReader::Open(const string &path)
+{
+    file.close();
+    file.clear();
+    index.clear();
+    file.open(path, ios::binary);
+    if (file.fail())
+    {
+        file.clear();
+        file.open(path + COMPRESSED_FILE_SUFFIX, ios::binary);
+        if (file.fail()) return false;
+    }
+
+    file.seekg(0, ios::end);
+    uint64_t size = file.tellg();
+    char magic[4] = { 0, 0, 0, 0 };
+    file.seekg(0);
+    if (size >= 4) file.read(magic, 4);
+    compressed = size >= 20 && memcmp(magic, COMPRESSED_FILE_MAGIC, 4) == 0;
+
+    if (!compressed)
+    {
+        for (uint64_t offset = 0; offset < size; offset += HISTORICAL_BLOCK_SIZE)
+        {
+            uint64_t length = size - offset < HISTORICAL_BLOCK_SIZE ? size - offset : HISTORICAL_BLOCK_SIZE;
+            BlockIndexEntry entry;
+            entry.fileOffset = offset;
+            entry.rawOffset = offset;
+            entry.rawSize = uint32_t(length);
+            entry.storedSize = uint32_t(length);
+            index.push_back(entry);
+        }
+        return true;
+    }
+
+    char footer[16];
+    file.seekg(size - 16);
+    file.read(footer, 16);
+    if (memcmp(footer + 12, COMPRESSED_INDEX_MAGIC, 4) != 0) return false;
+    uint64_t index_offset = GetU64(footer);
+    uint32_t count = GetU32(footer + 8);
+    if (index_offset + uint64_t(count) * 24 + 16 != size) return false;
+
+    file.seekg(index_offset);
+    char entry[24];
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        file.read(entry, 24);
+        BlockIndexEntry e;
+        e.fileOffset = GetU64(entry);
+        e.rawOffset = GetU64(entry + 8);
+        e.rawSize = GetU32(entry + 16);
+        e.storedSize = GetU32(entry + 20);
+        index.push_back(e);
+    }
+    return !file.fail();
+}
+
+bool HistoricalFileReader::IsCompressed() const
+{
+    return compressed;
+}
+
+size_t HistoricalFileReader::GetBlockCount() const
+{
+    return index.size();
+}
+
+const BlockIndexEntry& HistoricalFileReader::GetBlockEntry(size_t i) const
+{
+    return index[i];
+}
+
+bool HistoricalFileReader::ReadBlock(size_t i, string &output)
+{
+    const BlockIndexEntry &entry = index[i];
+    output.resize(entry.rawSize);
+    if (!compressed)
+    {
+        file.seekg(entry.fileOffset);
+        if (entry.rawSize) file.read(&output[0], entry.rawSize);
+        return !file.fail();
+    }
+
+    vector<char> stored(entry.storedSize);
+    file.seekg(entry.fileOffset + 8);
+    file.read(stored.data(), entry.storedSize);
+    if (file.fail()) return false;
+    if (entry.storedSize == entry.rawSize)
+    {
+        if (entry.rawSize) memcpy(&output[0], stored.data(), entry.rawSize);
+        return true;
+    }
+    long decoded = LZDecompress(stored.data(), stored.size(), &output[0], output.size());
+    return decoded == long(entry.rawSize);
+}
+
+bool HistoricalFileReader::ReadAll(string &output)
+{
+    output.clear();
+    string decoded;
+    for (size_t i = 0; i < index.size(); ++i)
+    {
+        if (!ReadBlock(i, decoded)) return false;
+        output += decoded;
+    }
+    return true;
+}
+
+#endif
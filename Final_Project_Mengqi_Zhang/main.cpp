@@ -16,18 +16,46 @@
 #include "pricingservice.hpp"
 #include "BondAlgoStreamingService.hpp"
 #include "BondPricingListener.hpp"
+#include "PositionStreamingListener.hpp"
+#include "conflatingpricequeue.hpp"
+#include "PricingAnalyticsListener.hpp"
+#include "PricingRiskListener.hpp"
+#include "PricingVaRListener.hpp"
+#include "PositionVaRListener.hpp"
+#include "PositionPnLListener.hpp"
+#include "PricingPnLListener.hpp"
+#include "PnLListener.hpp"
+#include "SpreadListener.hpp"
+#include "yieldservice.hpp"
+#include "curveservice.hpp"
+#include "CurveRiskListener.hpp"
+#include "PricingSpreadListener.hpp"
 #include "BondMarketDataListener.hpp"
 #include "inquiryservice.hpp"
 #include "historicaldataservice.hpp"
 #include "PositionDataListener.hpp"
 #include "RiskListener.hpp"
+#include "scenarioengine.hpp"
 #include "ExecutionListener.hpp"
 #include "StreamingListener.hpp"
 #include "InquiryListener.hpp"
+#include "benchmarks.hpp"
 
 
-int main()
+int main(int argc, char* argv[])
 {
+    //benchmarks replace the daily flow, see benchmarks.hpp
+    if (argc > 1 && string(argv[1]) == "--bench-format")
+    {
+        RunFormatterBenchmark(argc > 2 ? atol(argv[2]) : BENCH_FORMAT_ROWS);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-trades")
+    {
+        RunTradeBenchmark(argc > 2 ? atol(argv[2]) : BENCH_TRADE_EVENTS, argc > 3 ? atoi(argv[3]) : BENCH_AMEND_PERCENT);
+        return 0;
+    }
+    
     //A.Test tradebookservice & positionservice & riskservice
     BondTradeBookingService trade_srv;
     //input data to trade_srv through trade_conn
@@ -38,7 +66,13 @@ int main()
     BondTradeServiceListener trade_listener(position_srv);
     trade_srv.AddListener(&trade_listener);
     
-    BondRiskService risk_srv;
+    //yields and PV01 of every bond, solved from the latest prices
+    ThreadPool analytics_pool;
+    BondAnalytics analytics(ANALYTICS_SETTLEMENT_DATE, &analytics_pool);
+    //risk buckets and other sectors are defined in sectors.txt
+    SectorDefinitions sectors;
+    sectors.Load("sectors.txt");
+    BondRiskService risk_srv(analytics, sectors);
     //input data through position_listener
     BondPositionServiceListener position_listener(risk_srv);
     position_srv.AddListener(&position_listener);
@@ -51,11 +85,52 @@ int main()
     BondPricingService price_srv;
     //input data to price_srv through price_conn
     BondPricingConnector price_conn(price_srv);
-    
-    BondStreamingService streaming_srv;
-    BondAlgoStreamingService algo_streaming_srv(streaming_srv);
+    //every new mid is solved once here, before the listeners that read the analytics
+    PricingAnalyticsListener pricing_analytics_listener(analytics);
+    price_srv.AddListener(&pricing_analytics_listener);
+    
+    //publishes are not rate limited here; per stream and total token buckets are set here
+    BondStreamingService streaming_srv(0, 1, 0, 1);
+    //one tier of 10,000,000 at the bid/offer; more tiers and a position skew are configured here
+    BondAlgoStreamingService algo_streaming_srv(streaming_srv, vector<StreamingTier>(1, DEFAULT_STREAMING_TIER), 0);
+    PositionStreamingListener position_streaming_listener(algo_streaming_srv);
+    position_srv.AddListener(&position_streaming_listener);
     BondPricingListener position_srv_listener(algo_streaming_srv);
-    price_srv.AddListener(&position_srv_listener);
+    //streaming only needs the latest price of each product; the file is replayed
+    //one tick at a time, so the stage drains inline here and conflates nothing
+    ConflatingPriceQueue price_queue;
+    price_srv.AddListener(&price_queue);
+    price_queue.AddListener(&position_srv_listener);
+    //every new PV01 re-risks the position
+    PricingRiskListener pricing_risk_listener(risk_srv);
+    price_srv.AddListener(&pricing_risk_listener);
+    //historical VaR over the price moves and positions; prices.txt is replayed one product
+    //after another, so scenarios are keyed on each product's own ticks
+    BondVaRService var_srv(VAR_WINDOW, VAR_CONFIDENCE, VAR_RECOMPUTE_INTERVAL, &analytics_pool, VAR_TICK_STEPS);
+    PricingVaRListener pricing_var_listener(var_srv);
+    price_srv.AddListener(&pricing_var_listener);
+    PositionVaRListener position_var_listener(var_srv);
+    position_srv.AddListener(&position_var_listener);
+    //bid, mid and offer yields of the universe, solved when read
+    BondYieldService yield_srv(analytics);
+    price_srv.AddListener(&yield_srv);
+    //Nelson-Siegel curve through the on-the-run mids, refit at most every 64 prices
+    vector<string> on_the_run = {"912828M72", "912828N22", "912828M98", "912828M80", "912828M56", "912810RP5"};
+    BondCurveService curve_srv(analytics, on_the_run);
+    price_srv.AddListener(&curve_srv);
+    CurveRiskListener curve_risk_listener(risk_srv);
+    curve_srv.AddListener(&curve_risk_listener);
+    //curve spreads and butterflies are defined in spreads.txt
+    BondSpreadService spread_srv(analytics);
+    spread_srv.Load("spreads.txt");
+    PricingSpreadListener pricing_spread_listener(spread_srv);
+    price_srv.AddListener(&pricing_spread_listener);
+    //mark-to-market P&L, with trades filled at the latest mid
+    BondPnLService pnl_srv;
+    PositionPnLListener position_pnl_listener(pnl_srv);
+    position_srv.AddListener(&position_pnl_listener);
+    PricingPnLListener pricing_pnl_listener(pnl_srv);
+    price_srv.AddListener(&pricing_pnl_listener);
     
     //flow data from prices.txt into price_srv
     //price_conn.ReadFile("/Users/kikizhang/Desktop/Input_Files/prices.txt");
@@ -104,10 +179,58 @@ int main()
     InquiryListener his_inquiry_listener(his_inquiry_srv);
     inquiry_srv.AddListener(&his_inquiry_listener);
     
+    BondHistoricalPnLDataConnector his_pnl_conn;
+    BondHistoricalPnLDataService his_pnl_srv(his_pnl_conn);
+    PnLListener his_pnl_listener(his_pnl_srv);
+    pnl_srv.AddListener(&his_pnl_listener);
+    
+    BondHistoricalSpreadDataConnector his_spread_conn;
+    BondHistoricalSpreadDataService his_spread_srv(his_spread_conn);
+    SpreadListener his_spread_listener(his_spread_srv);
+    spread_srv.AddListener(&his_spread_listener);
+    
     market_data_conn.ReadFile("marketdata.txt");
     trade_conn.ReadFile("trades.txt");
     price_conn.ReadFile("prices.txt");
     inquiry_conn.ReadFile("inquiries.txt");
+    //streams still held back by the limits go out at the end of the day
+    streaming_srv.Flush();
+    
+    //F. Stress the end of day book with the scenarios in scenarios.txt
+    ScenarioSet scenarios(analytics);
+    scenarios.Load("scenarios.txt");
+    vector<BucketedSector<Bond>> buckets;
+    for (int i = 0; i < OTHER_BUCKET; ++i) buckets.push_back(risk_srv.GetSector(RISK_BUCKET_NAMES[i]));
+    ScenarioEngine scenario_engine(risk_srv, &analytics_pool);
+    ScenarioResults stress = scenario_engine.Run(scenarios, buckets);
+    for (size_t s = 0; s < stress.GetScenarioCount(); ++s)
+    {
+        cout << "Scenario " << stress.GetScenarioName(s);
+        for (size_t j = 0; j < stress.GetSectorCount(); ++j) cout << "," << stress.GetSectorName(j) << ":" << stress.GetPnL(s, j);
+        cout << ",Total:" << stress.GetTotalPnL(s) << endl;
+    }
+    const vector<double>& bid_yields = yield_srv.GetYields(BID_YIELD);
+    const vector<double>& mid_yields = yield_srv.GetYields(MID_YIELD);
+    const vector<double>& offer_yields = yield_srv.GetYields(OFFER_YIELD);
+    for (size_t slot = 0; slot < analytics.Size(); ++slot)
+    {
+        cout << "Yield " << analytics.GetBond(slot).GetProductId() << ",Bid:" << bid_yields[slot]
+             << ",Mid:" << mid_yields[slot] << ",Offer:" << offer_yields[slot] << endl;
+    }
+    curve_srv.Flush();
+    const YieldCurve& curve = curve_srv.GetCurve();
+    cout << "Curve Level:" << curve.GetLevel() << ",Slope:" << curve.GetSlope() << ",Curvature:" << curve.GetCurvature()
+         << ",Decay:" << curve.GetDecay() << ",RMS:" << curve.GetRmsError() << ",Fits:" << curve.GetFitNumber() << endl;
+    for (size_t i = 0; i < on_the_run.size(); ++i)
+        cout << "Curve Spread " << on_the_run[i] << ":" << risk_srv.GetCurveSpread(on_the_run[i]) << endl;
+    for (size_t i = 0; i < spread_srv.GetSpreadCount(); ++i)
+    {
+        const Spread<Bond>& spread = spread_srv.GetSpread(i);
+        cout << "Spread " << spread.GetName() << ",Yield:" << spread.GetYieldSpread() << "bp,Price:" << spread.GetPriceSpread() << endl;
+    }
+    cout << "Streaming Sent:" << streaming_srv.GetSentCount() << ",Suppressed:" << streaming_srv.GetSuppressedCount() << endl;
+    cout << "PnL Realized:" << pnl_srv.GetRealizedPnL() << ",Unrealized:" << pnl_srv.GetUnrealizedPnL() << endl;
+    cout << "VaR " << VAR_CONFIDENCE << ":" << var_srv.GetVaR() << ",ES:" << var_srv.GetExpectedShortfall() << endl;
     
     return 0;
 }
@@ -0,0 +1,348 @@
+/**
+ * pnlservice.hpp
+ * Defines the data types and Service for mark-to-market P&L.
+ *
+ * Trades carry no price, so a position change is filled at the product's mark, the
+ * latest mid from the pricing service. Each book keeps an average cost: adding to a
+ * position moves the cost, reducing it realizes the difference between the mark and
+ * the cost. Quantities traded before a product has any price are costed at its first mid.
+ *
+ * P&L is quantity times a price per 100 face, in the units of the risk totals.
+ */
+#ifndef PNL_SERVICE_HPP
+#define PNL_SERVICE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "soa.hpp"
+#include "chunkedarena.hpp"
+#include "positionservice.hpp"
+#include "pricingservice.hpp"
+
+using namespace std;
+
+/**
+ * Realized and unrealized P&L of a product in every book.
+ * Type T is the product type.
+ */
+template<typename T>
+class PnL
+{
+
+public:
+
+  // ctor for a flat product
+  PnL();
+  PnL(const T &_product);
+
+  // Get the product
+  const T& GetProduct() const;
+
+  // Get the position of an interned book id
+  long GetPosition(int book) const;
+
+  // Get the average cost of an interned book id
+  double GetAverageCost(int book) const;
+
+  // Get the realized P&L of an interned book id
+  double GetRealized(int book) const;
+
+  // Get the unrealized P&L of an interned book id
+  double GetUnrealized(int book) const;
+
+  // Get the realized P&L of all books
+  double GetRealized() const;
+
+  // Get the unrealized P&L of all books
+  double GetUnrealized() const;
+
+  // Get the realized and unrealized P&L of all books
+  double GetTotal() const;
+
+  // Get the mark price
+  double GetMark() const;
+
+  // Has the product been marked yet?
+  bool IsMarked() const;
+
+  // Fill a signed quantity in a book at the mark
+  void Fill(int book, long quantity);
+
+  // Mark every book to a new price
+  void Mark(double price);
+
+private:
+  T product;
+  long positions[MAX_BOOKS];
+  double cost[MAX_BOOKS];//average cost of the open position
+  double realized[MAX_BOOKS];
+  double unrealized[MAX_BOOKS];
+  double realizedTotal;//sums over the books, kept up to date by every change
+  double unrealizedTotal;
+  double mark;
+  bool marked;
+
+};
+
+/**
+ * P&L Service keeping the P&L of every product and book up to date.
+ * Keyed on product identifier.
+ * Type T is the product type.
+ */
+template<typename T>
+class PnLService : public Service<string,PnL <T> >
+{
+
+public:
+
+  // Take the new position of a product
+  virtual void AddPosition(Position<T> &position) = 0;
+
+  // Take a new price of a product
+  virtual void AddPrice(Price<T> &price) = 0;
+
+};
+
+/**
+ * Bond P&L Service.
+ * A position change costs O(1) per book that moved and a price costs O(books) for its
+ * product; the totals of the service are moved by the change of the one row.
+ */
+class BondPnLService: public PnLService<Bond>
+{
+private:
+    ChunkedArena<PnL<Bond>> pnl_rows;//one row per product, never moved once added
+    unordered_map<string, size_t> pnl_index;//map from cusip to its row
+    vector<ServiceListener<PnL<Bond>>*> listener_list;
+    double book_realized[MAX_BOOKS];//totals of each book id over all products
+    double book_unrealized[MAX_BOOKS];
+
+    PnL<Bond>& Row(const Bond& product);
+    void Publish(PnL<Bond>& row);
+public:
+    BondPnLService();
+    void AddPosition(Position<Bond>& position) override;
+    void AddPrice(Price<Bond>& price) override;
+    // Get the realized P&L of all products, of one book if one is given
+    double GetRealizedPnL() const;
+    double GetRealizedPnL(const string& book) const;
+    // Get the unrealized P&L of all products, of one book if one is given
+    double GetUnrealizedPnL() const;
+    double GetUnrealizedPnL(const string& book) const;
+
+    PnL<Bond>& GetData(string cusip) override;
+    void OnMessage(PnL<Bond>& data) override;
+    void AddListener(ServiceListener<PnL<Bond>>* listener) override;
+    const vector<ServiceListener<PnL<Bond>>*>& GetListeners() const override;
+};
+
+template<typename T>
+PnL<T>::PnL() : positions(), cost(), realized(), unrealized(), realizedTotal(0), unrealizedTotal(0), mark(0), marked(false)
+{
+}
+
+template<typename T>
+PnL<T>::PnL(const T &_product) :
+  product(_product), positions(), cost(), realized(), unrealized(), realizedTotal(0), unrealizedTotal(0), mark(0), marked(false)
+{
+}
+
+template<typename T>
+const T& PnL<T>::GetProduct() const
+{
+  return product;
+}
+
+template<typename T>
+long PnL<T>::GetPosition(int book) const
+{
+  return positions[book];
+}
+
+template<typename T>
+double PnL<T>::GetAverageCost(int book) const
+{
+  return cost[book];
+}
+
+template<typename T>
+double PnL<T>::GetRealized(int book) const
+{
+  return realized[book];
+}
+
+template<typename T>
+double PnL<T>::GetUnrealized(int book) const
+{
+  return unrealized[book];
+}
+
+template<typename T>
+double PnL<T>::GetRealized() const
+{
+  return realizedTotal;
+}
+
+template<typename T>
+double PnL<T>::GetUnrealized() const
+{
+  return unrealizedTotal;
+}
+
+template<typename T>
+double PnL<T>::GetTotal() const
+{
+  return realizedTotal + unrealizedTotal;
+}
+
+template<typename T>
+double PnL<T>::GetMark() const
+{
+  return mark;
+}
+
+template<typename T>
+bool PnL<T>::IsMarked() const
+{
+  return marked;
+}
+
+//the part of the fill against the open position realizes, the rest opens at the mark
+template<typename T>
+void PnL<T>::Fill(int book, long quantity)
+{
+  long open = positions[book];
+  long closing = 0;
+  if ((open > 0 && quantity < 0) || (open < 0 && quantity > 0))
+  {
+    closing = -quantity;
+    if (closing > open && open > 0) closing = open;
+    if (closing < open && open < 0) closing = open;
+  }
+  if (closing)
+  {
+    double gain = closing * (mark - cost[book]);
+    realized[book] += gain;
+    realizedTotal += gain;
+  }
+  long opening = quantity + closing;
+  long position = open + quantity;
+  if (opening) cost[book] = (double(position - opening) * cost[book] + double(opening) * mark) / position;
+  positions[book] = position;
+
+  double value = marked ? position * (mark - cost[book]) : 0;
+  unrealizedTotal += value - unrealized[book];
+  unrealized[book] = value;
+}
+
+template<typename T>
+void PnL<T>::Mark(double price)
+{
+  if (!marked)
+  {
+    for (int b = 0; b < MAX_BOOKS; ++b) cost[b] = price;
+    marked = true;
+  }
+  mark = price;
+  unrealizedTotal = 0;
+  for (int b = 0; b < MAX_BOOKS; ++b)
+  {
+    unrealized[b] = positions[b] * (mark - cost[b]);
+    unrealizedTotal += unrealized[b];
+  }
+}
+
+BondPnLService::BondPnLService() : book_realized(), book_unrealized()
+{
+}
+
+PnL<Bond>& BondPnLService::Row(const Bond& product)
+{
+    auto iter = pnl_index.find(product.GetProductId());
+    if (iter != pnl_index.end()) return pnl_rows[iter->second];
+    size_t slot = pnl_rows.Add(PnL<Bond>(product));
+    pnl_index[product.GetProductId()] = slot;
+    return pnl_rows[slot];
+}
+
+//only the books whose quantity moved are filled
+void BondPnLService::AddPosition(Position<Bond>& position)
+{
+    PnL<Bond>& row = Row(position.GetProduct());
+    bool changed = false;
+    for (int b = 0; b < MAX_BOOKS; ++b)
+    {
+        long quantity = position.GetPosition(b) - row.GetPosition(b);
+        if (!quantity) continue;
+        double realized = row.GetRealized(b), unrealized = row.GetUnrealized(b);
+        row.Fill(b, quantity);
+        book_realized[b] += row.GetRealized(b) - realized;
+        book_unrealized[b] += row.GetUnrealized(b) - unrealized;
+        changed = true;
+    }
+    if (changed) Publish(row);
+}
+
+void BondPnLService::AddPrice(Price<Bond>& price)
+{
+    PnL<Bond>& row = Row(price.GetProduct());
+    double unrealized[MAX_BOOKS];
+    for (int b = 0; b < MAX_BOOKS; ++b) unrealized[b] = row.GetUnrealized(b);
+    row.Mark(price.GetMid());
+    for (int b = 0; b < MAX_BOOKS; ++b) book_unrealized[b] += row.GetUnrealized(b) - unrealized[b];
+    Publish(row);
+}
+
+void BondPnLService::Publish(PnL<Bond>& row)
+{
+    for (size_t i = 0; i < listener_list.size(); ++i) listener_list[i]->ProcessAdd(row);
+}
+
+double BondPnLService::GetRealizedPnL() const
+{
+    double total = 0;
+    for (int b = 0; b < MAX_BOOKS; ++b) total += book_realized[b];
+    return total;
+}
+
+double BondPnLService::GetRealizedPnL(const string& book) const
+{
+    int book_id = FindBook(book);
+    return book_id < 0 ? 0 : book_realized[book_id];
+}
+
+double BondPnLService::GetUnrealizedPnL() const
+{
+    double total = 0;
+    for (int b = 0; b < MAX_BOOKS; ++b) total += book_unrealized[b];
+    return total;
+}
+
+double BondPnLService::GetUnrealizedPnL(const string& book) const
+{
+    int book_id = FindBook(book);
+    return book_id < 0 ? 0 : book_unrealized[book_id];
+}
+
+PnL<Bond>& BondPnLService::GetData(string cusip)
+{
+    auto iter = pnl_index.find(cusip);
+    if (iter != pnl_index.end()) return pnl_rows[iter->second];
+    cout << "No match!\n";
+    exit(-1);
+}
+
+void BondPnLService::OnMessage(PnL<Bond>& data){}
+
+void BondPnLService::AddListener(ServiceListener<PnL<Bond>>* listener)
+{
+    listener_list.push_back(listener);
+}
+
+const vector<ServiceListener<PnL<Bond>>*>& BondPnLService::GetListeners() const
+{
+    return listener_list;
+}
+
+#endif
@@ -10,11 +10,30 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
 #include "soa.hpp"
+#include "chunkedarena.hpp"
 #include "tradebookingservice.hpp"
 
 using namespace std;
 
+// Number of book columns in a position row
+const int MAX_BOOKS = 8;
+
+// Get the id of a book, interning the name on first sight; ids are dense from 0
+int InternBook(const string &book);
+
+// Get the id of a book, or -1 if it was never interned; safe to call from reader threads
+int FindBook(const string &book);
+
+// Get the name of an interned book
+const string& BookName(int book);
+
+// Get the number of interned books
+int BookCount();
+
 /**
  * Position class in a particular book.
  * Type T is the product type.
@@ -29,6 +48,7 @@ public:
   Position();
   Position(const T &_product);
   Position(const Trade<T> trade);
+  Position(const T &_product, const long *_positions);
 
   // Get the product
   const T& GetProduct() const;
@@ -36,14 +56,23 @@ public:
   // Get the position quantity
   long GetPosition(string &book) const;
 
+  // Get the position quantity of an interned book id
+  long GetPosition(int book) const;
+
   // Get the aggregate position
   long GetAggregatePosition() const;
 
   void AddTrade(Trade<Bond> & trade);
 
+  // Reverse a trade added before
+  void RemoveTrade(Trade<Bond> & trade);
+
 private:
   T product;
-  map<string,long> positions;//map from book to its position
+  long positions[MAX_BOOKS];//position of each interned book id
+  long aggregate;//sum of positions, kept up to date by every change
+
+  void Apply(int book, long quantity);
 
 };
 
@@ -63,31 +92,150 @@ public:
 
 };
 
+/**
+ * Reader copy of a position row, guarded by a sequence lock.
+ * The writer makes the version odd while it stores the books, so a reader that sees
+ * the same even version before and after its loads has a consistent copy.
+ * The product of the row never changes once the row is added.
+ */
+struct PositionCell
+{
+    PositionCell();
+    const Position<Bond>* row;
+    atomic<unsigned long> version;
+    atomic<long> positions[MAX_BOOKS];
+};
+
+/**
+ * The set of products visible to readers.
+ * Replaced as a whole when a product is added and reclaimed when the last reader lets go.
+ */
+struct PositionDirectory
+{
+    unordered_map<string, const PositionCell*> index;//map from cusip to its cell
+    vector<const PositionCell*> cells;//cells in the order the products were added
+};
+
+/**
+ * Bond Position Service.
+ * Trades are applied by a single writer thread. Other threads read through GetSnapshot
+ * and GetBookSnapshot, which never block the writer; GetData is for the writer thread only.
+ */
 class BondPositionService: public PositionService<Bond>
 {
 private:
-    map<string, Position<Bond>> Current_Position;//map from cusip to its position
+    ChunkedArena<Position<Bond>> Current_Position;//one dense row per product, never moved once added
+    ChunkedArena<PositionCell> Cells;//reader copy of each row, same slot as Current_Position
+    unordered_map<string, size_t> Position_Index;//map from cusip to its row in Current_Position
+    shared_ptr<const PositionDirectory> Directory;//read and replaced with atomic_load/atomic_store
+    atomic<unsigned long> Book_Version;//sequence lock over the whole book
     vector<ServiceListener<Position<Bond>>*> Listener_List;
 public:
-    BondPositionService(){cout<<"A BondPositionService is created!\n";}
+    BondPositionService();
     Position<Bond>& GetData(string cusip) override;
+    // Get a consistent copy of the position of a product from any thread
+    // Returns false if the product has no position yet
+    bool GetSnapshot(const string& cusip, Position<Bond>& snapshot) const;
+    // Get a copy of every position from any thread
+    // Returns true if the copy is a single point in time of the whole book; otherwise
+    // each position is still consistent on its own, taken after max_attempts tries
+    bool GetBookSnapshot(vector<Position<Bond>>& snapshot, int max_attempts = 16) const;
     void OnMessage(Position<Bond>& position) override;
     void AddListener(ServiceListener<Position<Bond>>* listener) override;
     const vector<ServiceListener<Position<Bond>>*>& GetListeners() const override;
     void AddTrade(Trade<Bond>& trade) override;
+    // Reverse a cancelled trade
+    void RemoveTrade(Trade<Bond>& trade);
+    // Replace a trade added before with its amended version, publishing each position once
+    void AmendTrade(Trade<Bond>& previous, Trade<Bond>& amended);
+private:
+    // Get the slot of a product, adding an empty row on first sight
+    size_t Row(const Bond& product);
+    // Copy a row to its reader cell
+    void Publish(size_t slot);
+    // Copy a cell under its sequence lock
+    static void ReadCell(const PositionCell& cell, long* positions);
+};
+
+//Definition of the book registry
+//TRSY1..TRSY3 are interned up front so they keep ids 0..2
+//names are only appended and count is published after the name, so FindBook needs no lock
+struct BookRegistry
+{
+    string names[MAX_BOOKS];
+    atomic<int> count;
+    unordered_map<string, int> ids;//writer side lookup
+    BookRegistry() : count(0)
+    {
+        const char* books[] = {"TRSY1", "TRSY2", "TRSY3"};
+        for (int i = 0; i < 3; ++i)
+        {
+            ids[books[i]] = i;
+            names[i] = books[i];
+        }
+        count.store(3, memory_order_release);
+    }
 };
 
+inline BookRegistry& Books()
+{
+    static BookRegistry registry;
+    return registry;
+}
+
+int InternBook(const string &book)
+{
+    BookRegistry& registry = Books();
+    auto iter = registry.ids.find(book);
+    if (iter != registry.ids.end()) return iter->second;
+    int id = registry.count.load(memory_order_relaxed);
+    if (id == MAX_BOOKS)
+    {
+        cout<<"Too many books: "<<book<<endl;
+        exit(-1);
+    }
+    registry.names[id] = book;
+    registry.ids[book] = id;
+    registry.count.store(id + 1, memory_order_release);
+    return id;
+}
+
+int FindBook(const string &book)
+{
+    BookRegistry& registry = Books();
+    int count = registry.count.load(memory_order_acquire);
+    for (int i = 0; i < count; ++i)
+    {
+        if (registry.names[i] == book) return i;
+    }
+    return -1;
+}
+
+const string& BookName(int book)
+{
+    return Books().names[book];
+}
+
+int BookCount()
+{
+    return Books().count.load(memory_order_acquire);
+}
+
 //Definition of the Position class
 template<typename T>
-Position<T>::Position(){}
+Position<T>::Position() : positions(), aggregate(0){}
 
 template<typename T>
-Position<T>::Position(const T &_product) : product(_product){}
+Position<T>::Position(const T &_product) : product(_product), positions(), aggregate(0){}
 
 template<typename T>
-Position<T>::Position(const Trade<T> trade) : product(trade.GetProduct()){
-    if(trade.GetSide() == BUY) positions[trade.GetBook()] = trade.GetQuantity();
-    else positions[trade.GetBook()] = -trade.GetQuantity();
+Position<T>::Position(const T &_product, const long *_positions) : product(_product), positions(), aggregate(0){
+    for(int i = 0; i < MAX_BOOKS; ++i) Apply(i, _positions[i]);
+}
+
+template<typename T>
+Position<T>::Position(const Trade<T> trade) : product(trade.GetProduct()), positions(), aggregate(0){
+    Apply(InternBook(trade.GetBook()), trade.GetSide() == BUY ? trade.GetQuantity() : -trade.GetQuantity());
 }
 
 template<typename T>
@@ -99,46 +247,138 @@ const T& Position<T>::GetProduct() const
 template<typename T>
 long Position<T>::GetPosition(string &book) const
 {
-    for(auto iter = positions.begin(); iter != positions.end(); ++iter){
-        if(iter->first == book) return iter->second;
-    }
-  return 0;
+    int id = FindBook(book);
+    return id < 0 ? 0 : positions[id];
+}
+
+template<typename T>
+long Position<T>::GetPosition(int book) const
+{
+    return positions[book];
 }
 
 template<typename T>
 long Position<T>::GetAggregatePosition() const
 {
-    long result;
-    for(auto iter = positions.begin(); iter != positions.end(); ++iter)
-    {
-        result += iter->second;
-    }
-  return result;
+    return aggregate;
+}
+
+//every change goes through here so the aggregate never needs a rescan
+template<typename T>
+void Position<T>::Apply(int book, long quantity)
+{
+    positions[book] += quantity;
+    aggregate += quantity;
 }
 
 template<typename T>
     void Position<T>::AddTrade(Trade<Bond> & trade)
     {
-        auto iter = positions.begin();
-        for(; iter != positions.end(); ++iter){
-            if(iter->first == trade.GetBook()){
-                if(trade.GetSide() == BUY) positions[trade.GetBook()]+=trade.GetQuantity();
-                else positions[trade.GetBook()] -= trade.GetQuantity();
-                break;
-            }
-        }
-        
-        if(iter == positions.end())
-        {
-            if(trade.GetSide()==BUY) positions[trade.GetBook()] = trade.GetQuantity();
-            else positions[trade.GetBook()] = -trade.GetQuantity();
-        }
+        Apply(InternBook(trade.GetBook()), trade.GetSide() == BUY ? trade.GetQuantity() : -trade.GetQuantity());
+    }
+    
+template<typename T>
+    void Position<T>::RemoveTrade(Trade<Bond> & trade)
+    {
+        Apply(InternBook(trade.GetBook()), trade.GetSide() == BUY ? -trade.GetQuantity() : trade.GetQuantity());
     }
     
+//Definition of the PositionCell struct
+PositionCell::PositionCell() : row(0), version(0)
+{
+    for(int i = 0; i < MAX_BOOKS; ++i) positions[i].store(0, memory_order_relaxed);
+}
+
 //Definition of BondPositionService class
+BondPositionService::BondPositionService() : Directory(make_shared<PositionDirectory>()), Book_Version(0)
+{
+    cout<<"A BondPositionService is created!\n";
+}
+
 Position<Bond>& BondPositionService::GetData(string CUSIP)
 {
-    return Current_Position[CUSIP];
+    return Current_Position[Row(Bond(CUSIP))];
+}
+
+//a new product gets its row and cell first, then a new directory is published for readers
+size_t BondPositionService::Row(const Bond& product)
+{
+    auto iter = Position_Index.find(product.GetProductId());
+    if(iter != Position_Index.end()) return iter->second;
+    size_t slot = Current_Position.Add(Position<Bond>(product));
+    Cells.Add();
+    Cells[slot].row = &Current_Position[slot];
+    Position_Index[product.GetProductId()] = slot;
+    
+    shared_ptr<PositionDirectory> directory = make_shared<PositionDirectory>(*atomic_load(&Directory));
+    directory->index[product.GetProductId()] = &Cells[slot];
+    directory->cells.push_back(&Cells[slot]);
+    atomic_store(&Directory, shared_ptr<const PositionDirectory>(directory));
+    return slot;
+}
+
+void BondPositionService::Publish(size_t slot)
+{
+    const Position<Bond>& position = Current_Position[slot];
+    PositionCell& cell = Cells[slot];
+    unsigned long book_version = Book_Version.load(memory_order_relaxed);
+    unsigned long version = cell.version.load(memory_order_relaxed);
+    Book_Version.store(book_version + 1, memory_order_relaxed);
+    cell.version.store(version + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for(int i = 0; i < MAX_BOOKS; ++i) cell.positions[i].store(position.GetPosition(i), memory_order_relaxed);
+    cell.version.store(version + 2, memory_order_release);
+    Book_Version.store(book_version + 2, memory_order_release);
+}
+
+void BondPositionService::ReadCell(const PositionCell& cell, long* positions)
+{
+    while(true)
+    {
+        unsigned long version = cell.version.load(memory_order_acquire);
+        if(version & 1) continue;
+        for(int i = 0; i < MAX_BOOKS; ++i) positions[i] = cell.positions[i].load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if(cell.version.load(memory_order_relaxed) == version) return;
+    }
+}
+
+bool BondPositionService::GetSnapshot(const string& cusip, Position<Bond>& snapshot) const
+{
+    shared_ptr<const PositionDirectory> directory = atomic_load(&Directory);
+    auto iter = directory->index.find(cusip);
+    if(iter == directory->index.end()) return false;
+    long positions[MAX_BOOKS];
+    ReadCell(*iter->second, positions);
+    snapshot = Position<Bond>(iter->second->row->GetProduct(), positions);
+    return true;
+}
+
+bool BondPositionService::GetBookSnapshot(vector<Position<Bond>>& snapshot, int max_attempts) const
+{
+    shared_ptr<const PositionDirectory> directory = atomic_load(&Directory);
+    size_t count = directory->cells.size();
+    vector<long> positions(count * MAX_BOOKS);
+    bool consistent = false;
+    for(int attempt = 0; attempt < max_attempts && !consistent; ++attempt)
+    {
+        unsigned long book_version = Book_Version.load(memory_order_acquire);
+        if(book_version & 1) continue;
+        for(size_t i = 0; i < count; ++i) ReadCell(*directory->cells[i], &positions[i * MAX_BOOKS]);
+        atomic_thread_fence(memory_order_acquire);
+        consistent = Book_Version.load(memory_order_relaxed) == book_version;
+    }
+    //the last pass may have been skipped or torn across rows, rows are still consistent
+    if(!consistent)
+    {
+        for(size_t i = 0; i < count; ++i) ReadCell(*directory->cells[i], &positions[i * MAX_BOOKS]);
+    }
+    
+    snapshot.clear();
+    snapshot.reserve(count);
+    for(size_t i = 0; i < count; ++i)
+        snapshot.push_back(Position<Bond>(directory->cells[i]->row->GetProduct(), &positions[i * MAX_BOOKS]));
+    return consistent;
 }
     
 void BondPositionService::OnMessage(Position<Bond>& position)
@@ -158,26 +398,47 @@ const vector<ServiceListener<Position<Bond>>*>& BondPositionService::GetListener
     return Listener_List;
 }
 
+//listeners get the live row after the trade, not a copy, so they see the full position
 void BondPositionService::AddTrade(Trade<Bond>& trade)
 {
-    auto iter = Current_Position.begin();
-    for(; iter != Current_Position.end(); ++iter){
-        if(trade.GetProduct().GetProductId()==iter->first){
-            iter->second.AddTrade(trade);
-            Position<Bond> temp(trade);
-            this->OnMessage(temp);
-            //test
-            //cout<<"A position of exiting product is added! "<<trade.GetProduct().GetProductId()<<endl;
-            break;
-        }
+    size_t slot = Row(trade.GetProduct());
+    Position<Bond>& position = Current_Position[slot];
+    position.AddTrade(trade);
+    Publish(slot);
+    this->OnMessage(position);
+}
+
+//reverse the trade and publish the live row, like AddTrade
+void BondPositionService::RemoveTrade(Trade<Bond>& trade)
+{
+    auto iter = Position_Index.find(trade.GetProduct().GetProductId());
+    if(iter == Position_Index.end()) return;
+    Position<Bond>& position = Current_Position[iter->second];
+    position.RemoveTrade(trade);
+    Publish(iter->second);
+    this->OnMessage(position);
+}
+
+//both versions are applied before anything is published, so listeners never see the
+//position without the trade; an amendment to another product changes and publishes both rows
+void BondPositionService::AmendTrade(Trade<Bond>& previous, Trade<Bond>& amended)
+{
+    auto iter = Position_Index.find(previous.GetProduct().GetProductId());
+    if(iter == Position_Index.end())
+    {
+        AddTrade(amended);
+        return;
     }
-    if(iter == Current_Position.end()){
-        Position<Bond> temp(trade);
-        Current_Position[trade.GetProduct().GetProductId()] = temp;
-        this->OnMessage(temp);
-        //test
-        //cout<<"A position of a new product is added! "<<trade.GetProduct().GetProductId()<<endl;
+    size_t previous_slot = iter->second;
+    size_t slot = Row(amended.GetProduct());
+    Current_Position[previous_slot].RemoveTrade(previous);
+    Current_Position[slot].AddTrade(amended);
+    Publish(previous_slot);
+    if(slot != previous_slot)
+    {
+        Publish(slot);
+        this->OnMessage(Current_Position[previous_slot]);
     }
-    
+    this->OnMessage(Current_Position[slot]);
 }
 #endif
@@ -10,7 +10,12 @@
 #include <string>
 #include "soa.hpp"
 #include <vector>
+#include <unordered_map>
 #include "products.hpp"
+#include "chunkedarena.hpp"
+
+// Default number of recent ticks kept per product
+const size_t PRICE_HISTORY_CAPACITY = 256;
 
 /**
  * A price object consisting of mid and bid/offer spread.
@@ -35,7 +40,7 @@ public:
   double GetBidOfferSpread() const;
 
 private:
-  const T& product;
+  T product;
   double mid;
   double bidOfferSpread;
 
@@ -51,16 +56,41 @@ class PricingService : public Service<string,Price <T> >
 {
 };
 
+/**
+ * A past tick of a product, kept without the product.
+ */
+struct PriceTick
+{
+    double mid;
+    double bidOfferSpread;
+};
+
+/**
+ * Bond Pricing Service.
+ * Keeps the live price of every product and a ring of its most recent ticks, so memory
+ * stays flat however many prices arrive.
+ */
 class BondPricingService: public PricingService<Bond>
 {
 private:
-    vector<Price<Bond>> bond_price;
+    ChunkedArena<Price<Bond>> bond_price;//live price of each product, never moved once added
+    unordered_map<string, size_t> price_index;//map from cusip to its slot in bond_price
+    size_t history_capacity;
+    vector<PriceTick> price_history;//tick n of slot p at price_history[p * history_capacity + n % history_capacity]
+    vector<size_t> tick_count;//ticks seen per slot
     vector<ServiceListener<Price<Bond>>*> listener_list;
 public:
-    BondPricingService(){cout<<"A BondPricingService is created!\n";}//ctor
+    BondPricingService(size_t _history_capacity = PRICE_HISTORY_CAPACITY);//ctor
     
+    // Get the live price of a product
     Price<Bond>& GetData(string cusip) override;
     
+    // Get the number of ticks of a product still in its history
+    size_t GetHistorySize(const string& cusip) const;
+    
+    // Get a recent price of a product, age 0 being the live one
+    Price<Bond> GetHistoricalPrice(const string& cusip, size_t age) const;
+    
     void OnMessage(Price<Bond>& price) override;
     
     void AddListener(ServiceListener<Price<Bond>>* listener) override;
@@ -80,19 +110,58 @@ public:
 };
 
 //Definition of BondPricingService class
+BondPricingService::BondPricingService(size_t _history_capacity) : history_capacity(_history_capacity ? _history_capacity : 1)
+{
+    cout<<"A BondPricingService is created!\n";
+}
+
 Price<Bond>& BondPricingService::GetData(string cusip){
-    for(int i = 0; i< bond_price.size(); ++i){
-        if(bond_price[i].GetProduct().GetProductId() == cusip) return bond_price[i];
-    }
+    auto iter = price_index.find(cusip);
+    if(iter != price_index.end()) return bond_price[iter->second];
     exit(-1);
 }
 
+size_t BondPricingService::GetHistorySize(const string& cusip) const{
+    auto iter = price_index.find(cusip);
+    if(iter == price_index.end()) return 0;
+    size_t count = tick_count[iter->second];
+    return count < history_capacity ? count : history_capacity;
+}
+
+Price<Bond> BondPricingService::GetHistoricalPrice(const string& cusip, size_t age) const{
+    auto iter = price_index.find(cusip);
+    if(iter == price_index.end() || age >= GetHistorySize(cusip)){
+        cout<<"No price history: "<<cusip<<endl;
+        exit(-1);
+    }
+    size_t slot = iter->second;
+    const PriceTick& tick = price_history[slot * history_capacity + (tick_count[slot] - 1 - age) % history_capacity];
+    return Price<Bond>(bond_price[slot].GetProduct(), tick.mid, tick.bidOfferSpread);
+}
+
+//the live price is overwritten in place and the oldest tick of the ring is dropped
 void BondPricingService::OnMessage(Price<Bond>& price){
-    bond_price.push_back(price);
+    const string& cusip = price.GetProduct().GetProductId();
+    auto iter = price_index.find(cusip);
+    size_t slot;
+    if(iter == price_index.end()){
+        slot = bond_price.Add(price);
+        price_index[cusip] = slot;
+        price_history.resize(price_history.size() + history_capacity);
+        tick_count.push_back(0);
+    }
+    else{
+        slot = iter->second;
+        bond_price[slot] = price;
+    }
+    PriceTick& tick = price_history[slot * history_capacity + tick_count[slot]++ % history_capacity];
+    tick.mid = price.GetMid();
+    tick.bidOfferSpread = price.GetBidOfferSpread();
     
+    Price<Bond>& live = bond_price[slot];
     for(int i = 0; i<listener_list.size(); ++i)
     {
-        listener_list[i]->ProcessAdd(price);
+        listener_list[i]->ProcessAdd(live);
     }
     //test
     //cout<<"New price information is added!\n";
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <string>
 #include <cmath>
+#include <cstdio>
 #include "boost/date_time/gregorian/gregorian.hpp"
 
 
@@ -22,6 +23,8 @@ double DecimalBondPrice(string price);
 
 string FractionalBondPrice(double price);
 
+size_t FractionalBondPrice(double price, char *output);
+
 /**
  * Base class for a product.
  */
@@ -426,18 +429,24 @@ double DecimalBondPrice (string price)
 
 //convert bond price from decimal number to fractional notation
 string FractionalBondPrice(double price)
+{
+    char result[32];
+    size_t length = FractionalBondPrice(price, result);
+    return string(result, length);
+}
+
+//convert bond price from decimal number to fractional notation into a caller buffer of at least 32 chars
+//returns the number of characters written
+size_t FractionalBondPrice(double price, char *output)
 {
     double decimal_int_part, decimal_part;
     decimal_part = modf(price, &decimal_int_part);
-    string int_part = to_string((int)decimal_int_part);
     decimal_part *= 32;
-    int fract_part1, fract_part2;
-    fract_part1 = (int)floor(decimal_part);
-    fract_part2 = (int)((decimal_part - fract_part1)*8);
-    string last_digit, result(int_part);
-    result += "-";
-    if (fract_part1 < 10) result += "0";
-    return result;
+    int fract_part1 = (int)floor(decimal_part);
+    int length = snprintf(output, 32, "%d-", (int)decimal_int_part);
+    if (fract_part1 < 10) output[length++] = '0';
+    output[length] = '\0';
+    return length;
 }
 
 
@@ -0,0 +1,201 @@
+/**
+ * recordformatter.hpp
+ * Fixed-width record formatting for the historical data files.
+ * Each column width is a template argument, so the layout of a record is fixed at compile time
+ * and a row is written into a preallocated character buffer without any iostream formatting.
+ * The output is byte-identical to the equivalent "setw(Width) << value" sequence.
+ */
+#ifndef RECORD_FORMATTER_HPP
+#define RECORD_FORMATTER_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "products.hpp"
+
+using namespace std;
+
+// Capacity of a single formatted record
+const size_t RECORD_BUFFER_SIZE = 1024;
+
+// Month names as printed by boost::gregorian::date
+const char* const MONTH_NAMES[] = { "", "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+/**
+ * A single record being formatted.
+ * Every Put<Width> appends one right-aligned column of at least Width characters,
+ * like "setw(Width) << value" does. Width 0 appends the value without padding.
+ */
+class RecordBuffer
+{
+
+public:
+
+  // ctor for an empty record
+  RecordBuffer();
+
+  // Append a string column
+  template<int Width> void Put(const char *value, size_t length);
+  template<int Width> void Put(const char *value);
+  template<int Width> void Put(const string &value);
+
+  // Append an integer column
+  template<int Width> void Put(long value);
+
+  // Append a floating point column in fixed notation with 6 decimals (like "<< fixed")
+  template<int Width> void PutFixed(double value);
+
+  // Append a floating point column in the default notation (like a plain "<<")
+  template<int Width> void PutGeneral(double value);
+
+  // Append a date column formatted as 2017-Nov-30
+  template<int Width> void PutDate(const date &value);
+
+  // Append a bond price column in fractional notation
+  template<int Width> void PutFractional(double price);
+
+  // Terminate the record with a new line
+  void EndLine();
+
+  // Get the formatted characters
+  const char* GetData() const;
+
+  // Get the number of formatted characters
+  size_t GetSize() const;
+
+  // Discard the record
+  void Clear();
+
+private:
+  char buffer[RECORD_BUFFER_SIZE];
+  size_t size;
+
+  void Pad(int width, size_t length);
+  template<int Width> void PutPrintf(const char *format, double value);
+
+};
+
+RecordBuffer::RecordBuffer() : size(0)
+{
+}
+
+void RecordBuffer::Pad(int width, size_t length)
+{
+    if ((long)length >= width) return;
+    size_t count = width - length;
+    if (size + count > RECORD_BUFFER_SIZE) count = RECORD_BUFFER_SIZE - size;
+    memset(buffer + size, ' ', count);
+    size += count;
+}
+
+template<int Width>
+void RecordBuffer::Put(const char *value, size_t length)
+{
+    Pad(Width, length);
+    if (size + length > RECORD_BUFFER_SIZE) length = RECORD_BUFFER_SIZE - size;
+    memcpy(buffer + size, value, length);
+    size += length;
+}
+
+template<int Width>
+void RecordBuffer::Put(const char *value)
+{
+    Put<Width>(value, strlen(value));
+}
+
+template<int Width>
+void RecordBuffer::Put(const string &value)
+{
+    Put<Width>(value.data(), value.size());
+}
+
+template<int Width>
+void RecordBuffer::Put(long value)
+{
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *begin = end;
+    unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+    do
+    {
+        *--begin = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) *--begin = '-';
+    Put<Width>(begin, end - begin);
+}
+
+template<int Width>
+void RecordBuffer::PutPrintf(const char *format, double value)
+{
+    char digits[RECORD_BUFFER_SIZE];
+    int length = snprintf(digits, sizeof(digits), format, value);
+    if (length < 0) length = 0;
+    if (length >= (int)sizeof(digits)) length = sizeof(digits) - 1;
+    Put<Width>(digits, length);
+}
+
+template<int Width>
+void RecordBuffer::PutFixed(double value)
+{
+    PutPrintf<Width>("%.6f", value);
+}
+
+template<int Width>
+void RecordBuffer::PutGeneral(double value)
+{
+    PutPrintf<Width>("%g", value);
+}
+
+template<int Width>
+void RecordBuffer::PutDate(const date &value)
+{
+    if (value.is_special())
+    {
+        Put<Width>(to_simple_string(value));
+        return;
+    }
+    date::ymd_type ymd = value.year_month_day();
+    char text[12];
+    int year = ymd.year;
+    text[0] = char('0' + year / 1000 % 10);
+    text[1] = char('0' + year / 100 % 10);
+    text[2] = char('0' + year / 10 % 10);
+    text[3] = char('0' + year % 10);
+    text[4] = '-';
+    memcpy(text + 5, MONTH_NAMES[ymd.month], 3);
+    text[8] = '-';
+    text[9] = char('0' + ymd.day / 10);
+    text[10] = char('0' + ymd.day % 10);
+    Put<Width>(text, 11);
+}
+
+template<int Width>
+void RecordBuffer::PutFractional(double price)
+{
+    char text[32];
+    size_t length = FractionalBondPrice(price, text);
+    Put<Width>(text, length);
+}
+
+void RecordBuffer::EndLine()
+{
+    if (size < RECORD_BUFFER_SIZE) buffer[size++] = '\n';
+}
+
+const char* RecordBuffer::GetData() const
+{
+    return buffer;
+}
+
+size_t RecordBuffer::GetSize() const
+{
+    return size;
+}
+
+void RecordBuffer::Clear()
+{
+    size = 0;
+}
+
+#endif
@@ -10,8 +10,14 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <cstdint>
 #include "soa.hpp"
 #include "positionservice.hpp"
+#include "pricingservice.hpp"
+#include "bondanalytics.hpp"
+#include "sectordefinitions.hpp"
+#include "curveservice.hpp"
 
 
 /**
@@ -46,16 +52,47 @@ private:
 
 };
 
-//A function returns the corresponding PV01 value given CUSIP
-double BondPV01(string cusip){
-    if (cusip == "912828M72") return 0.01974732;
-    else if (cusip == "912828N22") return 0.029349458;
-    else if (cusip == "912828M98") return 0.047720509;
-    else if (cusip == "912828M80") return 0.06495714;
-    else if (cusip == "912828M56") return 0.089254107;
-    else if (cusip == "912810RP5") return 0.198018642;
-    return 0;
-}
+// Risk buckets reported by the historical risk store
+// Each is the configured sector of the same name; OTHER_BUCKET holds products in none of them
+enum RiskBucket { FRONTEND, BELLY, LONGEND, OTHER_BUCKET };
+const int RISK_BUCKET_COUNT = 4;
+const char* const RISK_BUCKET_NAMES[] = { "FrontEnd", "Belly", "LongEnd" };
+
+/**
+ * A change-tracking risk event.
+ * Carries the PV01 of the one product that changed together with the bucket totals
+ * after the change. Checkpoint events are emitted periodically for every product
+ * so that a persisted delta stream can be replayed from the last checkpoint.
+ * Type T is the product type.
+ */
+template<typename T>
+class RiskUpdate
+{
+
+public:
+
+  // ctor for a risk update
+  RiskUpdate(const PV01<T> &_risk, const double *_bucketRisk, long _sequence, bool _checkpoint);
+
+  // Get the PV01 of the updated product
+  const PV01<T>& GetRisk() const;
+
+  // Get the total risk of a bucket after this update
+  double GetBucketRisk(RiskBucket bucket) const;
+
+  // Get the sequence number of the change this event belongs to
+  long GetSequence() const;
+
+  // Is this event part of a full checkpoint?
+  bool IsCheckpoint() const;
+
+private:
+  PV01<T> risk;
+  double bucketRisk[RISK_BUCKET_COUNT];
+  long sequence;
+  bool checkpoint;
+
+};
 
 /**
  * A bucket sector to bucket a group of securities.
@@ -106,17 +143,76 @@ class BondRiskService: public RiskService<Bond>
 {
 private:
     vector<ServiceListener<PV01<Bond>>*> listener_list;
-    vector<ServiceListener<vector<PV01<Bond>>>*> historical_data_listener_list;
+    vector<ServiceListener<RiskUpdate<Bond>>*> historical_data_listener_list;
+    BondAnalytics& analytics;//PV01 source, solved from the latest prices
     vector<PV01<Bond>> risk_position;
+    vector<size_t> risk_analytics;//slot in analytics of each slot in risk_position
+    unordered_map<string, size_t> risk_index;//map from cusip to its slot in risk_position
+    vector<long> book_quantity;//position of each (slot, book id), MAX_BOOKS entries per slot
+    SectorDefinitions sector_definitions;//rules of the tracked sectors
+    vector<uint64_t> sector_mask;//sectors of each slot in risk_position, compiled once per product
+    int bucket_sector[OTHER_BUCKET];//sector id of each reported bucket, -1 if not configured
+    uint64_t bucket_mask;//sectors of all reported buckets
+    double other_risk[MAX_BOOKS];//risk of each book id in none of the reported buckets
+    vector<double> sector_risk;//total risk of each sector, maintained incrementally
+    vector<double> sector_book_risk;//risk of each (sector, book id), MAX_BOOKS entries per sector
+    size_t key_rate_count;//number of key rate tenors in analytics
+    vector<double> key_rate_01;//key rate PV01s of each slot, key_rate_count entries per slot
+    vector<double> key_rate_risk;//key rate risk of each (book id, tenor), key_rate_count entries per book
+    YieldCurve curve;//latest fitted curve, flat at zero before the first fit
+    long sequence;//number of risk changes so far
+    long checkpoint_interval;//number of deltas between two full checkpoints
+    
+    void PublishUpdate(size_t slot, bool checkpoint);
+    void PublishChange(size_t slot);
+    void MoveSectorRisk(size_t slot, int book, double change);
+    void MoveKeyRateRisk(int book, long quantity, const double* key_rate_change);
 public:
-    BondRiskService(){}
+    BondRiskService(BondAnalytics& _analytics, const SectorDefinitions& _sectors, long _checkpoint_interval = 100);
     void AddPosition(Position<Bond>& position) override;
+    // Re-risk the position of a product at the PV01 solved from its new mid
+    // The mid is solved on the analytics first, by PricingAnalyticsListener
+    void UpdatePrice(Price<Bond>& price);
+    // Track a sector so its risk is kept up to date; sectors may overlap
+    // Returns the id of the sector, the same id again for a name already tracked
+    size_t AddSector(const BucketedSector<Bond>& sector);
+    // Get the risked products of a tracked sector
+    BucketedSector<Bond> GetSector(const string& name) const;
+    // Get the bucketed risk for the bucket sector, O(1) for a tracked sector
     double GetBucketedRisk(const BucketedSector<Bond>& sector) const override;
+    // Get the bucketed risk of one book for the bucket sector
+    double GetBucketedRisk(const BucketedSector<Bond>& sector, const string& book) const;
+    // Get the total risk of one book in a risk bucket
+    double GetBookRisk(const string& book, RiskBucket bucket) const;
+    // Get the total risk to the key rate at a tenor index of analytics
+    double GetKeyRateRisk(size_t tenor) const;
+    // Get the risk of one book to the key rate at a tenor index of analytics
+    double GetKeyRateRisk(const string& book, size_t tenor) const;
+    // Re-solve every product from its current price and rebuild all risk totals
+    void Revalue();
+    // Get the number of risked products; their slots are dense from 0
+    size_t GetProductCount() const;
+    // Get the risk of the product in a slot
+    const PV01<Bond>& GetRisk(size_t slot) const;
+    // Get the slot in analytics of the product in a slot
+    size_t GetAnalyticsSlot(size_t slot) const;
+    // Get the tracked sectors of the product in a slot, one bit per sector id
+    uint64_t GetSectorMask(size_t slot) const;
+    // Get the tracked sectors
+    const SectorDefinitions& GetSectorDefinitions() const;
+    // Get the analytics the risk is solved with
+    const BondAnalytics& GetAnalytics() const;
+    // Take a new fitted curve
+    void UpdateCurve(const YieldCurve& _curve);
+    // Get the latest fitted curve
+    const YieldCurve& GetCurve() const;
+    // Get the yield of a risked product less the curve yield at its maturity
+    double GetCurveSpread(const string& cusip) const;
     
     PV01<Bond>& GetData(string cusip) override;
     void OnMessage(PV01<Bond>& data) override;
     void AddListener(ServiceListener<PV01<Bond>>* listener) override;
-    void AddHistoricalDataListener(ServiceListener<vector<PV01<Bond>>>* listener);
+    void AddHistoricalDataListener(ServiceListener<RiskUpdate<Bond>>* listener);
     const vector<ServiceListener<PV01<Bond>>*>& GetListeners() const override;
 };
 
@@ -155,6 +251,39 @@ const T& PV01<T>::GetProduct() const
     return product;
 }
 
+template<typename T>
+RiskUpdate<T>::RiskUpdate(const PV01<T> &_risk, const double *_bucketRisk, long _sequence, bool _checkpoint) :
+  risk(_risk)
+{
+  for (int i = 0; i < RISK_BUCKET_COUNT; ++i) bucketRisk[i] = _bucketRisk[i];
+  sequence = _sequence;
+  checkpoint = _checkpoint;
+}
+
+template<typename T>
+const PV01<T>& RiskUpdate<T>::GetRisk() const
+{
+  return risk;
+}
+
+template<typename T>
+double RiskUpdate<T>::GetBucketRisk(RiskBucket bucket) const
+{
+  return bucketRisk[bucket];
+}
+
+template<typename T>
+long RiskUpdate<T>::GetSequence() const
+{
+  return sequence;
+}
+
+template<typename T>
+bool RiskUpdate<T>::IsCheckpoint() const
+{
+  return checkpoint;
+}
+
 template<typename T>
 const vector<T>& BucketedSector<T>::GetProducts() const
 {
@@ -174,63 +303,315 @@ BucketedSector<T>::BucketedSector(const vector<T>& _products, string _name) :
   name = _name;
 }
 
+BondRiskService::BondRiskService(BondAnalytics& _analytics, const SectorDefinitions& _sectors, long _checkpoint_interval) :
+analytics(_analytics), sector_definitions(_sectors), bucket_mask(0), key_rate_count(_analytics.GetKeyRateCount()), sequence(0), checkpoint_interval(_checkpoint_interval)
+{
+    key_rate_risk.resize(MAX_BOOKS * key_rate_count, 0);
+    sector_risk.resize(sector_definitions.Size(), 0);
+    sector_book_risk.resize(sector_definitions.Size() * MAX_BOOKS, 0);
+    for (int i = 0; i < OTHER_BUCKET; ++i)
+    {
+        bucket_sector[i] = sector_definitions.FindSector(RISK_BUCKET_NAMES[i]);
+        if (bucket_sector[i] >= 0) bucket_mask |= uint64_t(1) << bucket_sector[i];
+    }
+    for (int b = 0; b < MAX_BOOKS; ++b) other_risk[b] = 0;
+}
+
+//the position is the full state of the product, so its aggregate replaces the risked quantity
 void BondRiskService::AddPosition(Position<Bond>& position)
 {
-    string cusip = position.GetProduct().GetProductId();
-    auto iter = risk_position.begin();
-    for(; iter!= risk_position.end(); ++iter)
+    const string& cusip = position.GetProduct().GetProductId();
+    auto iter = risk_index.find(cusip);
+    size_t slot;
+    if(iter != risk_index.end())
     {
-        if(cusip == iter->GetProduct().GetProductId())
-        {
-            long new_quantity = position.GetAggregatePosition() + iter->GetQuantity();
-            PV01<Bond> new_pv01(iter->GetProduct(), iter->GetPV01(), new_quantity);
-            *iter = new_pv01;
-            //test
-            //cout << "An existing risk position is updated!\n";
-            break;
-        }
+        slot = iter->second;
+        PV01<Bond>& risk = risk_position[slot];
+        long new_quantity = position.GetAggregatePosition();
+        risk = PV01<Bond>(risk.GetProduct(), risk.GetPV01(), new_quantity);
     }
-    if(iter == risk_position.end()){
-        PV01<Bond> new_pv01(position.GetProduct(), BondPV01(position.GetProduct().GetProductId()), position.GetAggregatePosition());
+    else
+    {
+        slot = risk_position.size();
+        size_t analytics_slot = analytics.AddBond(position.GetProduct());
+        PV01<Bond> new_pv01(position.GetProduct(), analytics.GetPV01(analytics_slot), position.GetAggregatePosition());
         risk_position.push_back(new_pv01);
-        //test
-        //cout << "A new risk position is created!\n";
+        risk_analytics.push_back(analytics_slot);
+        risk_index[cusip] = slot;
+        sector_mask.push_back(sector_definitions.Compile(position.GetProduct(), analytics.GetSettlement()));
+        book_quantity.resize(book_quantity.size() + MAX_BOOKS, 0);
+        for(size_t i = 0; i < key_rate_count; ++i) key_rate_01.push_back(analytics.GetKeyRate01(analytics_slot, i));
     }
+    
+    //only the books that moved change their totals
+    long* books = &book_quantity[slot * MAX_BOOKS];
+    double pv01 = risk_position[slot].GetPV01();
+    for(int b = 0; b < MAX_BOOKS; ++b)
+    {
+        long quantity = position.GetPosition(b);
+        if(quantity == books[b]) continue;
+        MoveSectorRisk(slot, b, (quantity - books[b]) * pv01);
+        MoveKeyRateRisk(b, quantity - books[b], &key_rate_01[slot * key_rate_count]);
+        books[b] = quantity;
+    }
+    PublishChange(slot);
+}
+
+//a new PV01 moves every bucket total the product is in by quantity times the PV01 change
+void BondRiskService::UpdatePrice(Price<Bond>& price)
+{
+    long analytics_slot = analytics.FindBond(price.GetProduct().GetProductId());
+    if(analytics_slot < 0) return;
+    
+    auto iter = risk_index.find(price.GetProduct().GetProductId());
+    if(iter == risk_index.end()) return;
+    size_t slot = iter->second;
+    PV01<Bond>& risk = risk_position[slot];
+    double change = analytics.GetPV01(analytics_slot) - risk.GetPV01();
+    if(change == 0) return;
+    
+    double key_rate_change[MAX_KEY_RATES];
+    double* key_rates = &key_rate_01[slot * key_rate_count];
+    for(size_t i = 0; i < key_rate_count; ++i)
+    {
+        double key_rate = analytics.GetKeyRate01(analytics_slot, i);
+        key_rate_change[i] = key_rate - key_rates[i];
+        key_rates[i] = key_rate;
+    }
+    const long* books = &book_quantity[slot * MAX_BOOKS];
+    for(int b = 0; b < MAX_BOOKS; ++b)
+    {
+        if(!books[b]) continue;
+        MoveSectorRisk(slot, b, books[b] * change);
+        MoveKeyRateRisk(b, books[b], key_rate_change);
+    }
+    risk = PV01<Bond>(risk.GetProduct(), analytics.GetPV01(analytics_slot), risk.GetQuantity());
+    PublishChange(slot);
+}
+
+//only the changed product goes out, except for the periodic full checkpoint
+void BondRiskService::PublishChange(size_t slot)
+{
+    ++sequence;
+    if(checkpoint_interval > 0 && sequence % checkpoint_interval == 0)
+    {
+        for(size_t i = 0; i < risk_position.size(); ++i) PublishUpdate(i, true);
+    }
+    else PublishUpdate(slot, false);
+}
+
+void BondRiskService::PublishUpdate(size_t slot, bool checkpoint)
+{
+    double bucket_risk[RISK_BUCKET_COUNT];
+    for(int i = 0; i < OTHER_BUCKET; ++i) bucket_risk[i] = bucket_sector[i] < 0 ? 0 : sector_risk[bucket_sector[i]];
+    bucket_risk[OTHER_BUCKET] = 0;
+    for(int b = 0; b < MAX_BOOKS; ++b) bucket_risk[OTHER_BUCKET] += other_risk[b];
+    RiskUpdate<Bond> update(risk_position[slot], bucket_risk, sequence, checkpoint);
     for(int i = 0; i < historical_data_listener_list.size(); ++i)
-        historical_data_listener_list[i]->ProcessAdd(risk_position);
+        historical_data_listener_list[i]->ProcessAdd(update);
 }
 
-double BondRiskService::GetBucketedRisk(const BucketedSector<Bond>& sector) const
+//walk the set bits of the product's membership mask
+void BondRiskService::MoveSectorRisk(size_t slot, int book, double change)
 {
-    vector<Bond> bondlist = sector.GetProducts();
-    double result = 0;
-    for(auto iter_bl = bondlist.begin(); iter_bl!=bondlist.end(); ++iter_bl)
+    if(!(sector_mask[slot] & bucket_mask)) other_risk[book] += change;
+    for(uint64_t mask = sector_mask[slot]; mask; mask &= mask - 1)
+    {
+        int sector = __builtin_ctzll(mask);
+        sector_risk[sector] += change;
+        sector_book_risk[sector * MAX_BOOKS + book] += change;
+    }
+}
+
+void BondRiskService::MoveKeyRateRisk(int book, long quantity, const double* key_rate_change)
+{
+    double* ladder = &key_rate_risk[book * key_rate_count];
+    for(size_t i = 0; i < key_rate_count; ++i) ladder[i] += quantity * key_rate_change[i];
+}
+
+//the full revaluation also clears the rounding the incremental totals pick up over a day
+void BondRiskService::Revalue()
+{
+    analytics.Revalue();
+    fill(sector_risk.begin(), sector_risk.end(), 0);
+    fill(sector_book_risk.begin(), sector_book_risk.end(), 0);
+    fill(key_rate_risk.begin(), key_rate_risk.end(), 0);
+    for(int b = 0; b < MAX_BOOKS; ++b) other_risk[b] = 0;
+    for(size_t slot = 0; slot < risk_position.size(); ++slot)
     {
-        string product_id = iter_bl->GetProductId();
-        for(auto iter_cp = risk_position.begin(); iter_cp != risk_position.end(); ++iter_cp)
+        PV01<Bond>& risk = risk_position[slot];
+        double pv01 = analytics.GetPV01(risk_analytics[slot]);
+        risk = PV01<Bond>(risk.GetProduct(), pv01, risk.GetQuantity());
+        double* key_rates = &key_rate_01[slot * key_rate_count];
+        for(size_t i = 0; i < key_rate_count; ++i) key_rates[i] = analytics.GetKeyRate01(risk_analytics[slot], i);
+        const long* books = &book_quantity[slot * MAX_BOOKS];
+        for(int b = 0; b < MAX_BOOKS; ++b)
         {
-            if(product_id == iter_cp->GetProduct().GetProductId())
-            {
-                result += (BondPV01(product_id) * iter_cp->GetQuantity());
-                break;
-            }
+            if(!books[b]) continue;
+            MoveSectorRisk(slot, b, books[b] * pv01);
+            MoveKeyRateRisk(b, books[b], key_rates);
         }
     }
+    ++sequence;
+    for(size_t slot = 0; slot < risk_position.size(); ++slot) PublishUpdate(slot, true);
+}
+
+//products already risked join the sector with their current risk
+size_t BondRiskService::AddSector(const BucketedSector<Bond>& sector)
+{
+    size_t id = sector_definitions.AddSector(sector.GetName());
+    if(id < sector_risk.size()) return id;
+    sector_risk.push_back(0);
+    sector_book_risk.resize(sector_book_risk.size() + MAX_BOOKS, 0);
+    
+    const vector<Bond>& bondlist = sector.GetProducts();
+    for(auto iter_bl = bondlist.begin(); iter_bl != bondlist.end(); ++iter_bl)
+    {
+        sector_definitions.AddCusip(id, iter_bl->GetProductId());
+        auto iter_rp = risk_index.find(iter_bl->GetProductId());
+        if(iter_rp == risk_index.end()) continue;
+        size_t slot = iter_rp->second;
+        if(sector_mask[slot] & (uint64_t(1) << id)) continue;
+        sector_mask[slot] |= uint64_t(1) << id;
+        for(int b = 0; b < MAX_BOOKS; ++b)
+        {
+            double risk = book_quantity[slot * MAX_BOOKS + b] * risk_position[slot].GetPV01();
+            sector_risk[id] += risk;
+            sector_book_risk[id * MAX_BOOKS + b] += risk;
+        }
+    }
+    return id;
+}
+
+BucketedSector<Bond> BondRiskService::GetSector(const string& name) const
+{
+    vector<Bond> products;
+    int id = sector_definitions.FindSector(name);
+    for(size_t slot = 0; id >= 0 && slot < risk_position.size(); ++slot)
+    {
+        if(sector_mask[slot] & (uint64_t(1) << id)) products.push_back(risk_position[slot].GetProduct());
+    }
+    return BucketedSector<Bond>(products, name);
+}
+
+//a sector that is not tracked is summed over its products
+double BondRiskService::GetBucketedRisk(const BucketedSector<Bond>& sector) const
+{
+    int id = sector_definitions.FindSector(sector.GetName());
+    if(id >= 0) return sector_risk[id];
+    
+    const vector<Bond>& bondlist = sector.GetProducts();
+    double result = 0;
+    for(auto iter_bl = bondlist.begin(); iter_bl != bondlist.end(); ++iter_bl)
+    {
+        auto iter_rp = risk_index.find(iter_bl->GetProductId());
+        if(iter_rp == risk_index.end()) continue;
+        const PV01<Bond>& risk = risk_position[iter_rp->second];
+        result += risk.GetPV01() * risk.GetQuantity();
+    }
+    return result;
+}
+
+double BondRiskService::GetBucketedRisk(const BucketedSector<Bond>& sector, const string& book) const
+{
+    int book_id = FindBook(book);
+    if(book_id < 0) return 0;
+    int id = sector_definitions.FindSector(sector.GetName());
+    if(id >= 0) return sector_book_risk[id * MAX_BOOKS + book_id];
+    const vector<Bond>& bondlist = sector.GetProducts();
+    double result = 0;
+    for(auto iter_bl = bondlist.begin(); iter_bl != bondlist.end(); ++iter_bl)
+    {
+        auto iter = risk_index.find(iter_bl->GetProductId());
+        if(iter == risk_index.end()) continue;
+        result += risk_position[iter->second].GetPV01() * book_quantity[iter->second * MAX_BOOKS + book_id];
+    }
+    return result;
+}
+
+double BondRiskService::GetBookRisk(const string& book, RiskBucket bucket) const
+{
+    int book_id = FindBook(book);
+    if(book_id < 0) return 0;
+    if(bucket == OTHER_BUCKET) return other_risk[book_id];
+    return bucket_sector[bucket] < 0 ? 0 : sector_book_risk[bucket_sector[bucket] * MAX_BOOKS + book_id];
+}
+
+double BondRiskService::GetKeyRateRisk(size_t tenor) const
+{
+    double result = 0;
+    for(int b = 0; b < MAX_BOOKS; ++b) result += key_rate_risk[b * key_rate_count + tenor];
     return result;
 }
 
+double BondRiskService::GetKeyRateRisk(const string& book, size_t tenor) const
+{
+    int book_id = FindBook(book);
+    if(book_id < 0) return 0;
+    return key_rate_risk[book_id * key_rate_count + tenor];
+}
+
+size_t BondRiskService::GetProductCount() const
+{
+    return risk_position.size();
+}
+
+const PV01<Bond>& BondRiskService::GetRisk(size_t slot) const
+{
+    return risk_position[slot];
+}
+
+size_t BondRiskService::GetAnalyticsSlot(size_t slot) const
+{
+    return risk_analytics[slot];
+}
+
+uint64_t BondRiskService::GetSectorMask(size_t slot) const
+{
+    return sector_mask[slot];
+}
+
+const SectorDefinitions& BondRiskService::GetSectorDefinitions() const
+{
+    return sector_definitions;
+}
+
+const BondAnalytics& BondRiskService::GetAnalytics() const
+{
+    return analytics;
+}
+
+void BondRiskService::UpdateCurve(const YieldCurve& _curve)
+{
+    curve = _curve;
+}
+
+const YieldCurve& BondRiskService::GetCurve() const
+{
+    return curve;
+}
+
+double BondRiskService::GetCurveSpread(const string& cusip) const
+{
+    auto iter = risk_index.find(cusip);
+    if (iter == risk_index.end())
+    {
+        cout << "No match!\n";
+        exit(-1);
+    }
+    const Bond& bond = risk_position[iter->second].GetProduct();
+    double years = (bond.GetMaturityDate() - analytics.GetSettlement()).days() / DAYS_PER_YEAR;
+    return analytics.GetYield(risk_analytics[iter->second]) - curve.GetYield(years);
+}
+
 PV01<Bond>& BondRiskService::GetData(string cusip)
 {
     if(!risk_position.size())
     {
         cout<<"Empty"<<endl;
     }
-    for(auto iter = risk_position.begin(); iter!= risk_position.end(); ++iter)
-    {
-        if(cusip == iter->GetProduct().GetProductId()){
-            return *iter;
-        }
-    }
+    auto iter = risk_index.find(cusip);
+    if(iter != risk_index.end()) return risk_position[iter->second];
     cout<<"No match!\n";
     exit(-1);
 }
@@ -239,7 +620,7 @@ void BondRiskService::AddListener(ServiceListener<PV01<Bond>>* listener){
     listener_list.push_back(listener);
 }
 
-void BondRiskService::AddHistoricalDataListener(ServiceListener<vector<PV01<Bond> > > *listener){
+void BondRiskService::AddHistoricalDataListener(ServiceListener<RiskUpdate<Bond> > *listener){
     historical_data_listener_list.push_back(listener);
 }
 
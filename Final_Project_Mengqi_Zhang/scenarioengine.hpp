@@ -0,0 +1,370 @@
+/**
+ * scenarioengine.hpp
+ * Full revaluation of the risk book under yield curve scenarios.
+ *
+ * A scenario is a yield shift in basis points at each key rate tenor of the analytics.
+ * A bond's yield moves by the tenor shifts weighted by its key rate PV01s as a share of
+ * its PV01, so to first order the P&L agrees with the key rate risk, and the bond is
+ * repriced in full from its cached schedule at the shifted yield. The P&L of each
+ * scenario is the change in dirty value of the current positions, summed per sector.
+ *
+ * Scenario file, one scenario per line after a header line:
+ *   Name,PARALLEL,<bp>
+ *   Name,TWIST,<bp at the first tenor>,<bp at the last tenor>     linear in years between
+ *   Name,LADDER,<bp> <bp> ...                                     one per tenor
+ */
+#ifndef SCENARIO_ENGINE_HPP
+#define SCENARIO_ENGINE_HPP
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <unordered_set>
+#include "riskservice.hpp"
+#include "threadpool.hpp"
+
+using namespace std;
+
+// Number of scenarios repriced by one task of a run
+const size_t SCENARIO_BLOCK = 16;
+
+/**
+ * A set of named scenarios on the key rate tenors of an analytics.
+ * The shifts are stored scenario by scenario, one entry per tenor.
+ */
+class ScenarioSet
+{
+
+public:
+
+  // ctor for an empty set on the key rate tenors of analytics
+  ScenarioSet(const BondAnalytics &analytics);
+
+  // Add a scenario with the same shift at every tenor
+  void AddParallel(const string &name, double bp);
+
+  // Add a scenario with a shift moving linearly in years from the first tenor to the last
+  void AddTwist(const string &name, double firstBp, double lastBp);
+
+  // Add a scenario with its shift given at every tenor
+  void AddLadder(const string &name, const vector<double> &bp);
+
+  // Read scenarios from a configuration file
+  void Load(const string &file);
+
+  // Get the number of scenarios
+  size_t Size() const;
+
+  // Get the name of a scenario
+  const string& GetName(size_t scenario) const;
+
+  // Get the shift of a scenario at a tenor in basis points
+  double GetShift(size_t scenario, size_t tenor) const;
+
+  // Get the number of tenors
+  size_t GetTenorCount() const;
+
+private:
+  vector<double> tenors;
+  vector<string> names;
+  vector<double> shifts;//shift of scenario s at tenor i at shifts[s * tenors.size() + i]
+
+};
+
+/**
+ * P&L of every scenario of a run for every requested sector and in total.
+ */
+class ScenarioResults
+{
+
+public:
+
+  // ctor for a zero table
+  ScenarioResults(const ScenarioSet &_scenarios, const vector<BucketedSector<Bond> > &_sectors);
+
+  // Get the number of scenarios
+  size_t GetScenarioCount() const;
+
+  // Get the name of a scenario
+  const string& GetScenarioName(size_t scenario) const;
+
+  // Get the number of sectors
+  size_t GetSectorCount() const;
+
+  // Get the name of a sector
+  const string& GetSectorName(size_t sector) const;
+
+  // Get the P&L of a sector under a scenario
+  double GetPnL(size_t scenario, size_t sector) const;
+
+  // Get the P&L of a sector under a scenario, 0 for a sector not in the run
+  double GetPnL(size_t scenario, const BucketedSector<Bond> &sector) const;
+
+  // Get the P&L of the whole book under a scenario
+  double GetTotalPnL(size_t scenario) const;
+
+  // Get the row of a scenario, one entry per sector followed by the total
+  double* GetRow(size_t scenario);
+
+private:
+  vector<string> scenarioNames;
+  vector<string> sectorNames;
+  vector<double> pnl;//row of sectorNames.size() + 1 entries per scenario
+
+};
+
+/**
+ * Scenario engine over the positions and analytics of a risk service.
+ * Blocks of scenarios are repriced in parallel when a pool is given; every block has
+ * its own scratch, and the analytics are only read.
+ */
+class ScenarioEngine
+{
+
+public:
+
+  // ctor for an engine over a risk service
+  ScenarioEngine(const BondRiskService &_risk, ThreadPool *_pool = 0);
+
+  // Reprice the book under every scenario, with P&L per sector
+  ScenarioResults Run(const ScenarioSet &scenarios, const vector<BucketedSector<Bond> > &sectors) const;
+
+private:
+  const BondRiskService &risk;
+  ThreadPool *pool;
+
+};
+
+ScenarioSet::ScenarioSet(const BondAnalytics &analytics)
+{
+    for (size_t i = 0; i < analytics.GetKeyRateCount(); ++i) tenors.push_back(analytics.GetKeyRateTenor(i));
+}
+
+void ScenarioSet::AddParallel(const string &name, double bp)
+{
+    AddLadder(name, vector<double>(tenors.size(), bp));
+}
+
+void ScenarioSet::AddTwist(const string &name, double firstBp, double lastBp)
+{
+    vector<double> bp(tenors.size(), firstBp);
+    double span = tenors.back() - tenors.front();
+    for (size_t i = 0; span > 0 && i < tenors.size(); ++i)
+        bp[i] = firstBp + (lastBp - firstBp) * (tenors[i] - tenors.front()) / span;
+    AddLadder(name, bp);
+}
+
+void ScenarioSet::AddLadder(const string &name, const vector<double> &bp)
+{
+    if (bp.size() != tenors.size())
+    {
+        cout << "Scenario " << name << " needs " << tenors.size() << " shifts" << endl;
+        exit(-1);
+    }
+    names.push_back(name);
+    shifts.insert(shifts.end(), bp.begin(), bp.end());
+}
+
+void ScenarioSet::Load(const string &file)
+{
+    ifstream f(file);
+    if (f.fail())
+    {
+        cout << "File open failed!" << endl;
+        exit(-1);
+    }
+    //take the first line out
+    string line;
+    getline(f, line);
+
+    while (getline(f, line))
+    {
+        vector<string> record;
+        stringstream ss(line);
+        string field;
+        while (getline(ss, field, ',')) record.push_back(field);
+        if (record.size() < 3) continue;
+
+        if (record[1] == "PARALLEL") AddParallel(record[0], stod(record[2]));
+        else if (record[1] == "TWIST" && record.size() > 3) AddTwist(record[0], stod(record[2]), stod(record[3]));
+        else if (record[1] == "LADDER")
+        {
+            vector<double> bp;
+            stringstream list(record[2]);
+            double shift;
+            while (list >> shift) bp.push_back(shift);
+            AddLadder(record[0], bp);
+        }
+        else cout << "Unknown scenario: " << line << endl;
+    }
+}
+
+size_t ScenarioSet::Size() const
+{
+    return names.size();
+}
+
+const string& ScenarioSet::GetName(size_t scenario) const
+{
+    return names[scenario];
+}
+
+double ScenarioSet::GetShift(size_t scenario, size_t tenor) const
+{
+    return shifts[scenario * tenors.size() + tenor];
+}
+
+size_t ScenarioSet::GetTenorCount() const
+{
+    return tenors.size();
+}
+
+ScenarioResults::ScenarioResults(const ScenarioSet &_scenarios, const vector<BucketedSector<Bond> > &_sectors)
+{
+    for (size_t s = 0; s < _scenarios.Size(); ++s) scenarioNames.push_back(_scenarios.GetName(s));
+    for (size_t j = 0; j < _sectors.size(); ++j) sectorNames.push_back(_sectors[j].GetName());
+    pnl.resize(scenarioNames.size() * (sectorNames.size() + 1), 0);
+}
+
+size_t ScenarioResults::GetScenarioCount() const
+{
+    return scenarioNames.size();
+}
+
+const string& ScenarioResults::GetScenarioName(size_t scenario) const
+{
+    return scenarioNames[scenario];
+}
+
+size_t ScenarioResults::GetSectorCount() const
+{
+    return sectorNames.size();
+}
+
+const string& ScenarioResults::GetSectorName(size_t sector) const
+{
+    return sectorNames[sector];
+}
+
+double ScenarioResults::GetPnL(size_t scenario, size_t sector) const
+{
+    return pnl[scenario * (sectorNames.size() + 1) + sector];
+}
+
+double ScenarioResults::GetPnL(size_t scenario, const BucketedSector<Bond> &sector) const
+{
+    for (size_t j = 0; j < sectorNames.size(); ++j)
+    {
+        if (sectorNames[j] == sector.GetName()) return GetPnL(scenario, j);
+    }
+    return 0;
+}
+
+double ScenarioResults::GetTotalPnL(size_t scenario) const
+{
+    return GetPnL(scenario, sectorNames.size());
+}
+
+double* ScenarioResults::GetRow(size_t scenario)
+{
+    return &pnl[scenario * (sectorNames.size() + 1)];
+}
+
+ScenarioEngine::ScenarioEngine(const BondRiskService &_risk, ThreadPool *_pool) : risk(_risk), pool(_pool)
+{
+}
+
+//inputs are laid out by analytics slot so every scenario is one pass of the repricing kernel
+ScenarioResults ScenarioEngine::Run(const ScenarioSet &scenarios, const vector<BucketedSector<Bond> > &sectors) const
+{
+    ScenarioResults results(scenarios, sectors);
+    const BondAnalytics &analytics = risk.GetAnalytics();
+    const SectorDefinitions &definitions = risk.GetSectorDefinitions();
+    size_t count = analytics.Size();
+    size_t tenor_count = scenarios.GetTenorCount();
+    size_t sector_count = sectors.size();
+    if (tenor_count != analytics.GetKeyRateCount())
+    {
+        cout << "Scenario tenors do not match the analytics" << endl;
+        exit(-1);
+    }
+    if (sector_count > MAX_SECTORS)
+    {
+        cout << "Too many sectors in a scenario run: " << sector_count << endl;
+        exit(-1);
+    }
+
+    //tracked sectors use the compiled masks, others their product lists
+    vector<int> tracked(sector_count);
+    vector<unordered_set<string> > listed(sector_count);
+    for (size_t j = 0; j < sector_count; ++j)
+    {
+        tracked[j] = definitions.FindSector(sectors[j].GetName());
+        if (tracked[j] >= 0) continue;
+        const vector<Bond> &bondlist = sectors[j].GetProducts();
+        for (auto iter = bondlist.begin(); iter != bondlist.end(); ++iter) listed[j].insert(iter->GetProductId());
+    }
+
+    //only the risked products with a position take part in the sums
+    vector<long> quantity(count, 0);
+    vector<uint64_t> membership(count, 0);
+    vector<size_t> held;
+    for (size_t slot = 0; slot < risk.GetProductCount(); ++slot)
+    {
+        const PV01<Bond> &position = risk.GetRisk(slot);
+        if (!position.GetQuantity()) continue;
+        size_t a = risk.GetAnalyticsSlot(slot);
+        quantity[a] = position.GetQuantity();
+        held.push_back(a);
+        for (size_t j = 0; j < sector_count; ++j)
+        {
+            bool member = tracked[j] >= 0 ? (risk.GetSectorMask(slot) >> tracked[j]) & 1
+                                          : listed[j].count(position.GetProduct().GetProductId()) > 0;
+            if (member) membership[a] |= uint64_t(1) << j;
+        }
+    }
+
+    vector<double> base_yield(count), base_dirty(count), weight(tenor_count * count);
+    for (size_t a = 0; a < count; ++a)
+    {
+        base_yield[a] = analytics.GetYield(a);
+        double pv01 = analytics.GetPV01(a);
+        for (size_t i = 0; i < tenor_count; ++i) weight[i * count + a] = pv01 ? analytics.GetKeyRate01(a, i) / pv01 : 0;
+    }
+    {
+        vector<double> discount(count), factor(count);
+        analytics.Reprice(base_yield.data(), base_dirty.data(), discount.data(), factor.data());
+    }
+
+    auto task = [&](size_t begin, size_t end)
+    {
+        vector<double> yields(count), dirty(count), discount(count), factor(count);
+        for (size_t s = begin; s < end; ++s)
+        {
+            for (size_t a = 0; a < count; ++a) yields[a] = base_yield[a];
+            for (size_t i = 0; i < tenor_count; ++i)
+            {
+                double shift = scenarios.GetShift(s, i) * BASIS_POINT;
+                const double *w = &weight[i * count];
+                for (size_t a = 0; a < count; ++a) yields[a] += w[a] * shift;
+            }
+            analytics.Reprice(yields.data(), dirty.data(), discount.data(), factor.data());
+
+            //prices are per 100 face like PV01, so P&L is in the units of the risk totals
+            double *row = results.GetRow(s);
+            for (size_t h = 0; h < held.size(); ++h)
+            {
+                size_t a = held[h];
+                double change = quantity[a] * (dirty[a] - base_dirty[a]);
+                row[sector_count] += change;
+                for (uint64_t mask = membership[a]; mask; mask &= mask - 1) row[__builtin_ctzll(mask)] += change;
+            }
+        }
+    };
+    if (pool) pool->ParallelFor(scenarios.Size(), SCENARIO_BLOCK, task);
+    else task(0, scenarios.Size());
+    return results;
+}
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * sectordefinitions.hpp
+ * Named bucket sectors defined by rules instead of code.
+ *
+ * A sector is the union of its rules: a range of years to maturity, a ticker, or explicit
+ * CUSIPs. The rules are compiled into a membership mask for a product once, when the
+ * product is first seen, so testing whether a product is in a sector is a single AND.
+ *
+ * Configuration file, one rule per line after a header line:
+ *   Sector,MATURITY,<min years>,<max years>     min <= years to maturity < max
+ *   Sector,TICKER,<ticker>
+ *   Sector,CUSIP,<cusip> <cusip> ...
+ */
+#ifndef SECTOR_DEFINITIONS_HPP
+#define SECTOR_DEFINITIONS_HPP
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <unordered_map>
+#include <cstdint>
+#include "products.hpp"
+
+using namespace std;
+
+// Number of sectors, one bit each in a membership mask
+const int MAX_SECTORS = 64;
+
+// Days per year used for years to maturity
+const double DAYS_PER_YEAR = 365.25;
+
+/**
+ * A set of named sectors and the rules that decide their members.
+ * Sector ids are dense from 0 in the order the sectors are defined.
+ */
+class SectorDefinitions
+{
+
+public:
+
+  // Define a sector, or get the id of a sector defined before
+  size_t AddSector(const string &name);
+
+  // Get the id of a sector, or -1 if it is not defined
+  int FindSector(const string &name) const;
+
+  // Get the number of sectors
+  size_t Size() const;
+
+  // Get the name of a sector
+  const string& GetName(size_t sector) const;
+
+  // Add the products with minYears <= years to maturity < maxYears to a sector
+  void AddMaturityRange(size_t sector, double minYears, double maxYears);
+
+  // Add the products with a ticker to a sector
+  void AddTicker(size_t sector, const string &ticker);
+
+  // Add a product to a sector
+  void AddCusip(size_t sector, const string &cusip);
+
+  // Read rules from a configuration file
+  void Load(const string &file);
+
+  // Get the sectors a bond belongs to, one bit per sector id
+  uint64_t Compile(const Bond &bond, const date &settlement) const;
+
+private:
+  struct MaturityRange
+  {
+    size_t sector;
+    double minYears;
+    double maxYears;
+  };
+
+  vector<string> names;
+  unordered_map<string, size_t> index;//map from sector name to its id
+  vector<MaturityRange> maturities;
+  unordered_map<string, uint64_t> tickers;//map from ticker to the sectors it is in
+  unordered_map<string, uint64_t> cusips;//map from cusip to the sectors it is listed in
+
+};
+
+size_t SectorDefinitions::AddSector(const string &name)
+{
+    auto iter = index.find(name);
+    if (iter != index.end()) return iter->second;
+    if (names.size() == MAX_SECTORS)
+    {
+        cout << "Too many sectors: " << name << endl;
+        exit(-1);
+    }
+    index[name] = names.size();
+    names.push_back(name);
+    return names.size() - 1;
+}
+
+int SectorDefinitions::FindSector(const string &name) const
+{
+    auto iter = index.find(name);
+    return iter == index.end() ? -1 : int(iter->second);
+}
+
+size_t SectorDefinitions::Size() const
+{
+    return names.size();
+}
+
+const string& SectorDefinitions::GetName(size_t sector) const
+{
+    return names[sector];
+}
+
+void SectorDefinitions::AddMaturityRange(size_t sector, double minYears, double maxYears)
+{
+    MaturityRange range = { sector, minYears, maxYears };
+    maturities.push_back(range);
+}
+
+void SectorDefinitions::AddTicker(size_t sector, const string &ticker)
+{
+    tickers[ticker] |= uint64_t(1) << sector;
+}
+
+void SectorDefinitions::AddCusip(size_t sector, const string &cusip)
+{
+    cusips[cusip] |= uint64_t(1) << sector;
+}
+
+void SectorDefinitions::Load(const string &file)
+{
+    ifstream f(file);
+    if (f.fail())
+    {
+        cout << "File open failed!" << endl;
+        exit(-1);
+    }
+    //take the first line out
+    string line;
+    getline(f, line);
+
+    while (getline(f, line))
+    {
+        vector<string> record;
+        stringstream ss(line);
+        string field;
+        while (getline(ss, field, ',')) record.push_back(field);
+        if (record.size() < 3) continue;
+
+        size_t sector = AddSector(record[0]);
+        if (record[1] == "MATURITY" && record.size() > 3) AddMaturityRange(sector, stod(record[2]), stod(record[3]));
+        else if (record[1] == "TICKER") AddTicker(sector, record[2]);
+        else if (record[1] == "CUSIP")
+        {
+            stringstream list(record[2]);
+            string cusip;
+            while (list >> cusip) AddCusip(sector, cusip);
+        }
+        else cout << "Unknown sector rule: " << line << endl;
+    }
+}
+
+uint64_t SectorDefinitions::Compile(const Bond &bond, const date &settlement) const
+{
+    uint64_t mask = 0;
+    auto cusip = cusips.find(bond.GetProductId());
+    if (cusip != cusips.end()) mask |= cusip->second;
+    auto ticker = tickers.find(bond.GetTicker());
+    if (ticker != tickers.end()) mask |= ticker->second;
+    if (!bond.GetMaturityDate().is_special())
+    {
+        double years = (bond.GetMaturityDate() - settlement).days() / DAYS_PER_YEAR;
+        for (size_t i = 0; i < maturities.size(); ++i)
+        {
+            if (years >= maturities[i].minYears && years < maturities[i].maxYears) mask |= uint64_t(1) << maturities[i].sector;
+        }
+    }
+    return mask;
+}
+
+#endif
@@ -0,0 +1,339 @@
+/**
+ * spreadservice.hpp
+ * Defines the data types and Service for curve spreads and butterflies.
+ *
+ * A spread is a weighted sum over its legs, such as 2s10s = 10Y - 2Y or the fly
+ * 2s5s10s = 2 * 5Y - 2Y - 10Y, taken both over the mid yields (in basis points) and
+ * over the mids. Every product keeps the list of spreads that have it as a leg, so a
+ * tick re-sums only those spreads and a product in no spread costs one lookup.
+ * A spread is published once all of its legs have a price.
+ */
+#ifndef SPREAD_SERVICE_HPP
+#define SPREAD_SERVICE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include "soa.hpp"
+#include "chunkedarena.hpp"
+#include "pricingservice.hpp"
+#include "bondanalytics.hpp"
+
+using namespace std;
+
+// Basis points per unit of yield
+const double BASIS_POINTS = 10000.0;
+
+/**
+ * A weighted combination of the yields and mids of its legs.
+ * Type T is the product type.
+ */
+template<typename T>
+class Spread
+{
+
+public:
+
+  // ctor for a spread
+  Spread();
+  Spread(const string &_name, const vector<string> &_legs, const vector<double> &_weights);
+
+  // Get the name of the spread
+  const string& GetName() const;
+
+  // Get the number of legs
+  size_t GetLegCount() const;
+
+  // Get the product identifier of a leg
+  const string& GetLeg(size_t leg) const;
+
+  // Get the weight of a leg
+  double GetWeight(size_t leg) const;
+
+  // Get the weighted sum of the leg yields in basis points
+  double GetYieldSpread() const;
+
+  // Get the weighted sum of the leg mids
+  double GetPriceSpread() const;
+
+  // Get the number of times the spread has changed
+  long GetUpdateCount() const;
+
+  // Set new values of the spread
+  void Update(double _yieldSpread, double _priceSpread);
+
+private:
+  string name;
+  vector<string> legs;
+  vector<double> weights;
+  double yieldSpread;
+  double priceSpread;
+  long updates;
+
+};
+
+/**
+ * Spread Service keeping every configured spread up to date.
+ * Keyed on spread name.
+ * Type T is the product type.
+ */
+template<typename T>
+class SpreadService : public Service<string,Spread <T> >
+{
+
+public:
+
+  // Take a new price of a product
+  virtual void AddPrice(Price<T> &price) = 0;
+
+};
+
+/**
+ * Bond Spread Service.
+ * Yields are read from the shared analytics, solved there by PricingAnalyticsListener.
+ */
+class BondSpreadService: public SpreadService<Bond>
+{
+private:
+    BondAnalytics& analytics;
+    ChunkedArena<Spread<Bond>> spread_rows;//one row per spread, never moved once added
+    unordered_map<string, size_t> spread_index;//map from spread name to its row
+    vector<size_t> leg_begin;//first leg of each spread in leg_product and leg_weight
+    vector<size_t> leg_product;//product slot of each leg
+    vector<double> leg_weight;
+    unordered_map<string, size_t> product_index;//map from cusip to its product slot
+    vector<vector<size_t>> dependents;//spreads with each product slot as a leg
+    vector<double> product_yield;//latest yield and mid of each product slot
+    vector<double> product_mid;
+    vector<char> product_priced;
+    vector<ServiceListener<Spread<Bond>>*> listener_list;
+    long recomputed;
+
+    size_t Product(const string& cusip);
+    void Recompute(size_t spread);
+public:
+    BondSpreadService(BondAnalytics& _analytics);
+    // Define a spread; a name already defined is left as it is
+    // Returns the row of the spread
+    size_t AddSpread(const string& name, const vector<string>& legs, const vector<double>& weights);
+    // Define the spreads of a file of lines Name,CUSIP:weight CUSIP:weight ...
+    void Load(const string& file);
+    void AddPrice(Price<Bond>& price) override;
+    // Get the number of defined spreads
+    size_t GetSpreadCount() const;
+    // Get the spread in a row; rows are dense from 0 in the order defined
+    const Spread<Bond>& GetSpread(size_t row) const;
+    // Get the number of spread recomputes so far
+    long GetRecomputeCount() const;
+
+    Spread<Bond>& GetData(string name) override;
+    void OnMessage(Spread<Bond>& data) override;
+    void AddListener(ServiceListener<Spread<Bond>>* listener) override;
+    const vector<ServiceListener<Spread<Bond>>*>& GetListeners() const override;
+};
+
+template<typename T>
+Spread<T>::Spread() : yieldSpread(0), priceSpread(0), updates(0)
+{
+}
+
+template<typename T>
+Spread<T>::Spread(const string &_name, const vector<string> &_legs, const vector<double> &_weights) :
+  name(_name), legs(_legs), weights(_weights), yieldSpread(0), priceSpread(0), updates(0)
+{
+}
+
+template<typename T>
+const string& Spread<T>::GetName() const
+{
+  return name;
+}
+
+template<typename T>
+size_t Spread<T>::GetLegCount() const
+{
+  return legs.size();
+}
+
+template<typename T>
+const string& Spread<T>::GetLeg(size_t leg) const
+{
+  return legs[leg];
+}
+
+template<typename T>
+double Spread<T>::GetWeight(size_t leg) const
+{
+  return weights[leg];
+}
+
+template<typename T>
+double Spread<T>::GetYieldSpread() const
+{
+  return yieldSpread;
+}
+
+template<typename T>
+double Spread<T>::GetPriceSpread() const
+{
+  return priceSpread;
+}
+
+template<typename T>
+long Spread<T>::GetUpdateCount() const
+{
+  return updates;
+}
+
+template<typename T>
+void Spread<T>::Update(double _yieldSpread, double _priceSpread)
+{
+  yieldSpread = _yieldSpread;
+  priceSpread = _priceSpread;
+  ++updates;
+}
+
+BondSpreadService::BondSpreadService(BondAnalytics& _analytics) : analytics(_analytics), leg_begin(1, 0), recomputed(0)
+{
+}
+
+size_t BondSpreadService::Product(const string& cusip)
+{
+    auto iter = product_index.find(cusip);
+    if (iter != product_index.end()) return iter->second;
+    size_t slot = dependents.size();
+    product_index[cusip] = slot;
+    dependents.push_back(vector<size_t>());
+    product_yield.push_back(0);
+    product_mid.push_back(0);
+    product_priced.push_back(0);
+    return slot;
+}
+
+size_t BondSpreadService::AddSpread(const string& name, const vector<string>& legs, const vector<double>& weights)
+{
+    auto iter = spread_index.find(name);
+    if (iter != spread_index.end()) return iter->second;
+    if (legs.empty() || legs.size() != weights.size())
+    {
+        cout << "Bad spread definition: " << name << endl;
+        exit(-1);
+    }
+    size_t spread = spread_rows.Add(Spread<Bond>(name, legs, weights));
+    spread_index[name] = spread;
+    for (size_t i = 0; i < legs.size(); ++i)
+    {
+        size_t product = Product(legs[i]);
+        leg_product.push_back(product);
+        leg_weight.push_back(weights[i]);
+        dependents[product].push_back(spread);
+    }
+    leg_begin.push_back(leg_product.size());
+    return spread;
+}
+
+void BondSpreadService::Load(const string& file)
+{
+    ifstream f(file);
+    if (f.fail())
+    {
+        cout << "File open failed!" << endl;
+        exit(-1);
+    }
+    //take the first line out
+    string line;
+    getline(f, line);
+
+    while (getline(f, line))
+    {
+        size_t comma = line.find(',');
+        if (comma == string::npos) continue;
+        vector<string> legs;
+        vector<double> weights;
+        stringstream list(line.substr(comma + 1));
+        string leg;
+        while (list >> leg)
+        {
+            size_t colon = leg.find(':');
+            if (colon == string::npos)
+            {
+                cout << "Bad spread leg: " << line << endl;
+                exit(-1);
+            }
+            legs.push_back(leg.substr(0, colon));
+            weights.push_back(stod(leg.substr(colon + 1)));
+        }
+        AddSpread(line.substr(0, comma), legs, weights);
+    }
+}
+
+void BondSpreadService::AddPrice(Price<Bond>& price)
+{
+    const Bond& bond = price.GetProduct();
+    auto iter = product_index.find(bond.GetProductId());
+    if (iter == product_index.end()) return;
+    size_t product = iter->second;
+    long slot = analytics.FindBond(bond.GetProductId());
+    if (slot < 0) return;
+    product_yield[product] = analytics.GetYield(slot);
+    product_mid[product] = price.GetMid();
+    product_priced[product] = 1;
+    const vector<size_t>& affected = dependents[product];
+    for (size_t i = 0; i < affected.size(); ++i) Recompute(affected[i]);
+}
+
+//a few legs each, so re-summing is as cheap as patching and never drifts
+void BondSpreadService::Recompute(size_t spread)
+{
+    double yield_spread = 0, price_spread = 0;
+    for (size_t leg = leg_begin[spread]; leg < leg_begin[spread + 1]; ++leg)
+    {
+        size_t product = leg_product[leg];
+        if (!product_priced[product]) return;
+        yield_spread += leg_weight[leg] * product_yield[product];
+        price_spread += leg_weight[leg] * product_mid[product];
+    }
+    ++recomputed;
+    Spread<Bond>& row = spread_rows[spread];
+    row.Update(yield_spread * BASIS_POINTS, price_spread);
+    for (size_t i = 0; i < listener_list.size(); ++i) listener_list[i]->ProcessAdd(row);
+}
+
+size_t BondSpreadService::GetSpreadCount() const
+{
+    return spread_rows.Size();
+}
+
+const Spread<Bond>& BondSpreadService::GetSpread(size_t row) const
+{
+    return spread_rows[row];
+}
+
+long BondSpreadService::GetRecomputeCount() const
+{
+    return recomputed;
+}
+
+Spread<Bond>& BondSpreadService::GetData(string name)
+{
+    auto iter = spread_index.find(name);
+    if (iter != spread_index.end()) return spread_rows[iter->second];
+    cout << "No match!\n";
+    exit(-1);
+}
+
+void BondSpreadService::OnMessage(Spread<Bond>& data){}
+
+void BondSpreadService::AddListener(ServiceListener<Spread<Bond>>* listener)
+{
+    listener_list.push_back(listener);
+}
+
+const vector<ServiceListener<Spread<Bond>>*>& BondSpreadService::GetListeners() const
+{
+    return listener_list;
+}
+
+#endif
@@ -7,6 +7,9 @@
 #ifndef STREAMING_SERVICE_HPP
 #define STREAMING_SERVICE_HPP
 
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
 #include "soa.hpp"
 #include "marketdataservice.hpp"
 
@@ -33,6 +36,9 @@ public:
   // Get the hidden quantity on this order
   long GetHiddenQuantity() const;
 
+  // Reprice the order in place
+  void Update(double _price, long _visibleQuantity, long _hiddenQuantity);
+
 private:
   double price;
   long visibleQuantity;
@@ -54,7 +60,7 @@ public:
   // ctor
     PriceStream(){}
     
-  PriceStream(const T &_product, const PriceStreamOrder &_bidOrder, const PriceStreamOrder &_offerOrder);
+  PriceStream(const T &_product, const PriceStreamOrder &_bidOrder, const PriceStreamOrder &_offerOrder, int _tier = 0);
 
   // Get the product
   const T& GetProduct() const;
@@ -65,10 +71,17 @@ public:
   // Get the offer order
   const PriceStreamOrder& GetOfferOrder() const;
 
+  // Get the tier of the stream, 0 for the top tier
+  int GetTier() const;
+
+  // Reprice both sides in place with the same quantities
+  void Update(double bidPrice, double offerPrice, long visibleQuantity, long hiddenQuantity);
+
 private:
   T product;
   PriceStreamOrder bidOrder;
   PriceStreamOrder offerOrder;
+  int tier;
 
 };
 
@@ -88,28 +101,146 @@ public:
 
 };
 
+// Default time between two passes over the throttled streams in nanoseconds
+const int64_t STREAM_POLL_INTERVAL = 100000;
+
+/**
+ * Token bucket and conflation state of one stream, kept together in one array.
+ */
+struct StreamThrottle
+{
+    double tokens;//publishes the stream may make now, up to the burst
+    int64_t refilled;//time of the last refill in nanoseconds
+    bool pending;//is a throttled update of the stream waiting?
+};
+
+/**
+ * Bond Streaming Service keeping the latest stream of every product and tier.
+ * GetData gives the latest top tier stream, whether or not it has been sent yet.
+ *
+ * Publishing can be limited per stream and in total by token buckets, each refilled at
+ * a rate per second up to a burst; a rate of 0 does not limit. Every tier of a product
+ * has its own bucket, so the product rate holds for each tier. An update without tokens
+ * is merged into the stream's pending latest value, which is sent once tokens are back,
+ * in the order the streams were throttled: updates are conflated, never lost, and never
+ * sent out of order. Pending streams are retried on later publishes every poll interval,
+ * on Poll, and sent regardless of the limits on Flush. With a total limit, a publish
+ * first retries the pending streams, so a fresh update only gets the tokens they leave.
+ */
 class BondStreamingService: public StreamingService<Bond>
 {
 private:
-    vector<PriceStream<Bond>> bond_price_stream;
+    vector<PriceStream<Bond>> bond_price_stream;//latest stream of each (product, tier)
+    vector<StreamThrottle> throttle;//bucket of each slot of bond_price_stream
+    unordered_map<string, vector<size_t>> stream_index;//map from cusip to the slot of each of its tiers
+    vector<size_t> pending_list;//throttled slots, in the order they were throttled
     vector<ServiceListener<PriceStream<Bond>>*> listener_list;
+    double product_rate;
+    double product_burst;
+    double global_rate;
+    double global_burst;
+    double global_tokens;
+    int64_t global_refilled;
+    int64_t poll_interval;
+    int64_t last_poll;
+    long sent;
+    long suppressed;
+
+    static int64_t Now();
+    void RefillGlobal(int64_t now);
+    bool TakeToken(size_t slot, int64_t now);
+    void Send(size_t slot);
+    void Drain(int64_t now, bool limited);
 public:
+    BondStreamingService(double _product_rate = 0, double _product_burst = 1, double _global_rate = 0, double _global_burst = 1,
+                         int64_t _poll_interval = STREAM_POLL_INTERVAL);
     PriceStream<Bond>& GetData(string cusip) override;
     void OnMessage(PriceStream<Bond>& price_stream) override;
     void AddListener(ServiceListener<PriceStream<Bond>>* listener) override;
     const vector<ServiceListener<PriceStream<Bond>>*>& GetListeners() const override;
     void PublishPrice(PriceStream<Bond>& price_stream) override;
+    // Send the pending streams the limits allow now
+    void Poll();
+    // Send every pending stream regardless of the limits
+    void Flush();
+    // Get the number of streams sent to the listeners
+    long GetSentCount() const;
+    // Get the number of updates throttled and merged into a pending stream
+    long GetSuppressedCount() const;
+    // Get the number of streams waiting to be sent
+    size_t GetPendingCount() const;
 };
 
-PriceStream<Bond>& BondStreamingService::GetData(string cusip)
+BondStreamingService::BondStreamingService(double _product_rate, double _product_burst, double _global_rate, double _global_burst,
+                                           int64_t _poll_interval) :
+product_rate(_product_rate), product_burst(_product_burst), global_rate(_global_rate), global_burst(_global_burst),
+global_tokens(_global_burst), global_refilled(Now()), poll_interval(_poll_interval), last_poll(0), sent(0), suppressed(0)
+{
+}
+
+int64_t BondStreamingService::Now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void BondStreamingService::RefillGlobal(int64_t now)
+{
+    global_tokens += (now - global_refilled) * 1e-9 * global_rate;
+    if(global_tokens > global_burst) global_tokens = global_burst;
+    global_refilled = now;
+}
+
+//refills both buckets and takes a token from each, or from neither
+bool BondStreamingService::TakeToken(size_t slot, int64_t now)
+{
+    StreamThrottle& state = throttle[slot];
+    if(product_rate > 0)
+    {
+        state.tokens += (now - state.refilled) * 1e-9 * product_rate;
+        if(state.tokens > product_burst) state.tokens = product_burst;
+        state.refilled = now;
+        if(state.tokens < 1) return false;
+    }
+    if(global_rate > 0)
+    {
+        RefillGlobal(now);
+        if(global_tokens < 1) return false;
+        global_tokens -= 1;
+    }
+    if(product_rate > 0) state.tokens -= 1;
+    return true;
+}
+
+void BondStreamingService::Send(size_t slot)
+{
+    throttle[slot].pending = false;
+    ++sent;
+    for(size_t i = 0; i < listener_list.size(); ++i) listener_list[i]->ProcessAdd(bond_price_stream[slot]);
+}
+
+//pending slots that cannot be sent yet keep their place at the front of the list;
+//once the total bucket is empty the rest of the list stays as it is
+void BondStreamingService::Drain(int64_t now, bool limited)
 {
-    if(bond_price_stream.size()==0) exit(-1);
-    long i;
-    for(i = bond_price_stream.size() -1; i>=0; --i)
+    last_poll = now;
+    bool global_limited = limited && global_rate > 0;
+    if(global_limited) RefillGlobal(now);
+    size_t kept = 0, i = 0;
+    for(; i < pending_list.size(); ++i)
     {
-        if(bond_price_stream[i].GetProduct().GetProductId() == cusip) return bond_price_stream[i];
+        if(global_limited && global_tokens < 1) break;
+        size_t slot = pending_list[i];
+        if(!limited || TakeToken(slot, now)) Send(slot);
+        else pending_list[kept++] = slot;
     }
-    exit(-1);
+    pending_list.erase(pending_list.begin() + kept, pending_list.begin() + i);
+}
+
+PriceStream<Bond>& BondStreamingService::GetData(string cusip)
+{
+    auto iter = stream_index.find(cusip);
+    if(iter == stream_index.end() || iter->second[0] == size_t(-1)) exit(-1);
+    return bond_price_stream[iter->second[0]];
 }
 
 void BondStreamingService::OnMessage(PriceStream<Bond>& price_stream)
@@ -127,12 +258,67 @@ const vector<ServiceListener<PriceStream<Bond>>*>& BondStreamingService::GetList
     return listener_list;
 }
 
+//a known (product, tier) is overwritten in place; only a new one grows the store
 void BondStreamingService::PublishPrice(PriceStream<Bond>& price_stream)
 {
-    bond_price_stream.push_back(price_stream);
-    for(int i = 0; i < listener_list.size(); ++i) listener_list[i]->ProcessAdd(price_stream);
-    //test
-    //cout<< "A bond price stream is added!\n";
+    int64_t now = (product_rate > 0 || global_rate > 0) ? Now() : 0;
+    vector<size_t>& tiers = stream_index[price_stream.GetProduct().GetProductId()];
+    size_t tier = price_stream.GetTier();
+    if(tier >= tiers.size()) tiers.resize(tier + 1, size_t(-1));
+    size_t slot = tiers[tier];
+    if(slot == size_t(-1))
+    {
+        slot = tiers[tier] = bond_price_stream.size();
+        bond_price_stream.push_back(price_stream);
+        StreamThrottle state = { product_burst, now, false };
+        throttle.push_back(state);
+    }
+    else bond_price_stream[slot] = price_stream;
+
+    //streams throttled earlier take the free total tokens first; a pending stream sent
+    //there already carries this update
+    bool pending = throttle[slot].pending;
+    if(global_rate > 0 && !pending_list.empty())
+    {
+        Drain(now, true);
+        if(pending && !throttle[slot].pending) return;
+    }
+    if(!throttle[slot].pending && TakeToken(slot, now)) Send(slot);
+    else
+    {
+        ++suppressed;
+        if(!throttle[slot].pending)
+        {
+            throttle[slot].pending = true;
+            pending_list.push_back(slot);
+        }
+    }
+    if(!pending_list.empty() && now - last_poll >= poll_interval) Drain(now, true);
+}
+
+void BondStreamingService::Poll()
+{
+    Drain(Now(), true);
+}
+
+void BondStreamingService::Flush()
+{
+    Drain(Now(), false);
+}
+
+long BondStreamingService::GetSentCount() const
+{
+    return sent;
+}
+
+long BondStreamingService::GetSuppressedCount() const
+{
+    return suppressed;
+}
+
+size_t BondStreamingService::GetPendingCount() const
+{
+    return pending_list.size();
 }
 
 PriceStreamOrder::PriceStreamOrder(double _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side)
@@ -158,9 +344,16 @@ long PriceStreamOrder::GetHiddenQuantity() const
   return hiddenQuantity;
 }
 
+void PriceStreamOrder::Update(double _price, long _visibleQuantity, long _hiddenQuantity)
+{
+  price = _price;
+  visibleQuantity = _visibleQuantity;
+  hiddenQuantity = _hiddenQuantity;
+}
+
 template<typename T>
-PriceStream<T>::PriceStream(const T &_product, const PriceStreamOrder &_bidOrder, const PriceStreamOrder &_offerOrder) :
-  product(_product), bidOrder(_bidOrder), offerOrder(_offerOrder)
+PriceStream<T>::PriceStream(const T &_product, const PriceStreamOrder &_bidOrder, const PriceStreamOrder &_offerOrder, int _tier) :
+  product(_product), bidOrder(_bidOrder), offerOrder(_offerOrder), tier(_tier)
 {
 }
 
@@ -182,4 +375,17 @@ const PriceStreamOrder& PriceStream<T>::GetOfferOrder() const
   return offerOrder;
 }
 
+template<typename T>
+int PriceStream<T>::GetTier() const
+{
+  return tier;
+}
+
+template<typename T>
+void PriceStream<T>::Update(double bidPrice, double offerPrice, long visibleQuantity, long hiddenQuantity)
+{
+  bidOrder.Update(bidPrice, visibleQuantity, hiddenQuantity);
+  offerOrder.Update(offerPrice, visibleQuantity, hiddenQuantity);
+}
+
 #endif
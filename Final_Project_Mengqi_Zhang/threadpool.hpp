@@ -0,0 +1,142 @@
+/**
+ * threadpool.hpp
+ * A fixed pool of worker threads for data-parallel loops.
+ * ParallelFor splits an index range into chunks that the workers and the calling
+ * thread take in turn, and returns when every chunk is done.
+ */
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+/**
+ * Thread pool running one parallel loop at a time.
+ */
+class ThreadPool
+{
+
+public:
+
+  // ctor for a pool with the given number of threads, the calling thread included
+  ThreadPool(size_t threads = thread::hardware_concurrency());
+  ~ThreadPool();
+
+  // Get the number of threads, the calling thread included
+  size_t Size() const;
+
+  // Run task(begin, end) over [0, count) in chunks of at least grain indices
+  void ParallelFor(size_t count, size_t grain, const function<void(size_t, size_t)> &task);
+
+private:
+  vector<thread> workers;
+  mutex lock;
+  condition_variable start;
+  condition_variable finish;
+  bool stopping;
+  unsigned long generation;//one per loop, wakes the workers
+
+  // current loop
+  const function<void(size_t, size_t)> *task;
+  size_t count;
+  size_t chunk;
+  atomic<size_t> next;
+  size_t active;//workers still inside the loop, guarded by lock
+
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  void WorkerLoop();
+  void RunChunks();
+
+};
+
+ThreadPool::ThreadPool(size_t threads) : stopping(false), generation(0), task(0), count(0), chunk(0), next(0), active(0)
+{
+    for (size_t i = 1; i < threads; ++i) workers.push_back(thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    start.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+}
+
+size_t ThreadPool::Size() const
+{
+    return workers.size() + 1;
+}
+
+void ThreadPool::ParallelFor(size_t _count, size_t grain, const function<void(size_t, size_t)> &_task)
+{
+    if (_count == 0) return;
+    if (grain == 0) grain = 1;
+    size_t chunks = Size() * 4;
+    size_t _chunk = (_count + chunks - 1) / chunks;
+    if (_chunk < grain) _chunk = grain;
+
+    //small loops are not worth waking anybody
+    if (workers.empty() || _chunk >= _count)
+    {
+        _task(0, _count);
+        return;
+    }
+
+    {
+        lock_guard<mutex> guard(lock);
+        task = &_task;
+        count = _count;
+        chunk = _chunk;
+        next.store(0);
+        active = workers.size();
+        ++generation;
+    }
+    start.notify_all();
+    RunChunks();
+
+    unique_lock<mutex> guard(lock);
+    while (active) finish.wait(guard);
+    task = 0;
+}
+
+void ThreadPool::RunChunks()
+{
+    while (true)
+    {
+        size_t begin = next.fetch_add(chunk);
+        if (begin >= count) return;
+        size_t end = begin + chunk < count ? begin + chunk : count;
+        (*task)(begin, end);
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    unsigned long seen = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            while (!stopping && generation == seen) start.wait(guard);
+            if (stopping) return;
+            seen = generation;
+        }
+        RunChunks();
+        {
+            lock_guard<mutex> guard(lock);
+            if (--active == 0) finish.notify_one();
+        }
+    }
+}
+
+#endif
@@ -11,7 +11,10 @@
 #include <vector>
 #include <sstream>
 #include <fstream>
+#include <unordered_map>
 #include "soa.hpp"
+#include "chunkedarena.hpp"
+#include "bloomfilter.hpp"
 #include "products.hpp"
 
 using namespace std;
@@ -70,19 +73,49 @@ class TradeBookingService : public Service<string, Trade<T> >
 
 };
 
+/**
+ * Listener that takes an amendment as one event with both versions of the trade.
+ * A trade listener that also derives from this gets ProcessAmend instead of
+ * ProcessRemove and ProcessUpdate, so it can apply the change as a single delta.
+ * Type T is the product type.
+ */
+template<typename T>
+class TradeAmendListener
+{
+
+public:
+
+  // Listener callback for a booked trade replaced by an amended version
+  virtual void ProcessAmend(Trade<T> &previous, Trade<T> &amended) = 0;
+
+};
+
 class BondTradeBookingService: public TradeBookingService<Bond>
 {
 private:
-    vector<Trade<Bond>> Trades_Book;
+    ChunkedArena<Trade<Bond>> Trades_Book;//booked trades, never moved once booked
+    unordered_map<string, size_t> Trade_Index;//map from trade ID to its slot in Trades_Book
+    vector<bool> Cancelled;//cancel flag of every slot in Trades_Book
+    BlockedBloomFilter Seen_Ids;//every trade ID booked today, checked before Trade_Index
+    long Duplicates;//replayed trades that were not booked again
     vector<ServiceListener<Trade<Bond>>*> Listeners_List;
+    vector<TradeAmendListener<Bond>*> Amend_Listeners;//same slot as Listeners_List, null if it takes no amendments
 public:
-    BondTradeBookingService();
+    BondTradeBookingService(size_t expected_trades = 1 << 16, size_t expected_daily_trades = 1 << 25);
     Trade<Bond>& GetData(string _tradeId) override;
     void OnMessage(Trade<Bond> &trades) override;
     void AddListener(ServiceListener< Trade<Bond> > * listeners) override;
     const vector< ServiceListener<Trade<Bond>>*>& GetListeners() const override;
     // Book the trade
     void BookTrade(const Trade<Bond> &trade);
+    // Replace a booked trade with a new version carrying the same trade ID.
+    // Amend listeners get ProcessAmend with both versions; other listeners get ProcessRemove
+    // with the previous version, then ProcessUpdate with the amended one.
+    void AmendTrade(const Trade<Bond> &trade);
+    // Cancel a booked trade; listeners get ProcessRemove with the cancelled trade
+    void CancelTrade(const string &tradeId);
+    // Get the number of trades dropped because their trade ID was already booked
+    long GetDuplicateCount() const;
 };
 
 class BondTradeBookingConnector : public Connector<Trade<Bond>>
@@ -95,29 +128,38 @@ public:
     void Publish(Trade<Bond> &data){}
 };
 
-//Default constructor
-BondTradeBookingService::BondTradeBookingService()
+//Constructor; the trade index is sized up front so booking does not rehash early in the day
+//and the duplicate filter is sized for a full day of trade IDs
+BondTradeBookingService::BondTradeBookingService(size_t expected_trades, size_t expected_daily_trades)
+: Seen_Ids(expected_daily_trades), Duplicates(0)
 {
+    Trade_Index.reserve(expected_trades);
     /*cout<<"BondTradeBookingService is created!\n";*/
 }
 
 //Get data of the tradebook given the trade ID
 Trade<Bond>& BondTradeBookingService::GetData(string _tradeId)
 {
-    for (auto itr = Trades_Book.begin(); itr != Trades_Book.end(); ++itr)
-    {
-        if ((*itr).GetTradeId() == _tradeId ) return (*itr);
-    }
+    auto itr = Trade_Index.find(_tradeId);
+    if (itr != Trade_Index.end()) return Trades_Book[itr->second];
     exit(-1);
 }
 
 //The callback that a Connector should invoke for any new or updated data
+//a trade ID that is already booked, e.g. from a replayed feed, is dropped
 void BondTradeBookingService::OnMessage(Trade<Bond> &trades)
 {
+    //a filter miss proves the ID is new; only a hit needs the exact index
+    if (Seen_Ids.MayContain(trades.GetTradeId()) && Trade_Index.count(trades.GetTradeId())){
+        ++Duplicates;
+        return;
+    }
     BookTrade(trades);
     
+    //listeners get the booked copy, which stays valid as the book grows
+    Trade<Bond>& booked = Trades_Book[Trades_Book.Size() - 1];
     for (int i = 0; i < Listeners_List.size(); ++i){
-        Listeners_List[i]->ProcessAdd(trades);
+        Listeners_List[i]->ProcessAdd(booked);
     }
     //test
     //cout<<"new trade added: "<<trades.GetProduct().GetProductId()<<endl;
@@ -127,6 +169,7 @@ void BondTradeBookingService::OnMessage(Trade<Bond> &trades)
 void BondTradeBookingService::AddListener(ServiceListener<Trade<Bond>> *listeners)
 {
     Listeners_List.push_back(listeners);
+    Amend_Listeners.push_back(dynamic_cast<TradeAmendListener<Bond>*>(listeners));
 };
 
 
@@ -138,10 +181,58 @@ const vector<ServiceListener<Trade<Bond>>*>& BondTradeBookingService::GetListene
 //book the trade
 void BondTradeBookingService::BookTrade(const Trade<Bond> &trade)
 {
-    Trades_Book.push_back(trade);
+    Trade_Index[trade.GetTradeId()] = Trades_Book.Add(trade);
+    Cancelled.push_back(false);
+    Seen_Ids.Add(trade.GetTradeId());
+}
+
+long BondTradeBookingService::GetDuplicateCount() const
+{
+    return Duplicates;
+}
+
+//amend the trade in place, so only the difference flows downstream
+void BondTradeBookingService::AmendTrade(const Trade<Bond> &trade)
+{
+    auto itr = Trade_Index.find(trade.GetTradeId());
+    if (itr == Trade_Index.end() || Cancelled[itr->second])
+    {
+        cout<<"No live trade to amend: "<<trade.GetTradeId()<<endl;
+        return;
+    }
+    Trade<Bond>& booked = Trades_Book[itr->second];
+    Trade<Bond> previous(booked);
+    booked = trade;
+    
+    for (size_t i = 0; i < Listeners_List.size(); ++i){
+        if (Amend_Listeners[i]){
+            Amend_Listeners[i]->ProcessAmend(previous, booked);
+            continue;
+        }
+        Listeners_List[i]->ProcessRemove(previous);
+        Listeners_List[i]->ProcessUpdate(booked);
+    }
+}
+
+//the cancelled trade stays in the book, flagged, so it can still be looked up
+void BondTradeBookingService::CancelTrade(const string &tradeId)
+{
+    auto itr = Trade_Index.find(tradeId);
+    if (itr == Trade_Index.end() || Cancelled[itr->second])
+    {
+        cout<<"No live trade to cancel: "<<tradeId<<endl;
+        return;
+    }
+    Cancelled[itr->second] = true;
+    Trade<Bond>& booked = Trades_Book[itr->second];
+    
+    for (size_t i = 0; i < Listeners_List.size(); ++i){
+        Listeners_List[i]->ProcessRemove(booked);
+    }
 }
 
 //flow data from a file into bond trade booking service
+//an optional sixth column AMEND or CANCEL corrects an earlier trade with the same trade ID
 void BondTradeBookingConnector::ReadFile(string file){
     ifstream f(file);
     if(f.fail()){
@@ -176,10 +267,13 @@ void BondTradeBookingConnector::ReadFile(string file){
         else{
             _side = BUY;
         }
+        string action = record.size() > 5 ? record[5] : "NEW";
         record.clear();
         Trade<Bond> new_t(new_b, id, book, quantity, _side);
         
-        Trade_Service.OnMessage(new_t);
+        if(action == "AMEND") Trade_Service.AmendTrade(new_t);
+        else if(action == "CANCEL") Trade_Service.CancelTrade(id);
+        else Trade_Service.OnMessage(new_t);
     }
     
     f.close();
@@ -0,0 +1,289 @@
+/**
+ * varservice.hpp
+ * Historical simulation value at risk over the live price history.
+ *
+ * Time is cut into steps shared by all products, and every product keeps its mid price
+ * move over each of the last window steps in a ring buffer, 0 for a step it did not move
+ * in. Scenario j of the book is step j of the ring of every product, so moves that
+ * happened together are applied together, and the P&L of a scenario is the sum of
+ * quantity times move. By default a step ends when a product that already moved in it
+ * moves again, so with products ticking in turn a step is one round of ticks; with a
+ * step interval it is that much wall-clock time. A feed replayed one product after
+ * another, like prices.txt, has no shared time, so there every product steps on its own
+ * ticks instead and scenario j holds move j of every product, modulo the window.
+ * A new mid changes one ring entry and one scenario, a new step clears one entry of
+ * every product, and a new position changes every scenario of one product, so the P&L
+ * vector is kept up to date without revisiting the book. It is recomputed in full every so many updates, in parallel when
+ * a pool is given, so rounding does not build up.
+ *
+ * P&L is quantity times the move of a price per 100 face, in the units of the risk totals.
+ */
+#ifndef VAR_SERVICE_HPP
+#define VAR_SERVICE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include "positionservice.hpp"
+#include "pricingservice.hpp"
+#include "threadpool.hpp"
+
+using namespace std;
+
+// Default number of price moves kept per product
+const size_t VAR_WINDOW = 500;
+
+// Default confidence level of VaR and expected shortfall
+const double VAR_CONFIDENCE = 0.99;
+
+// Default number of updates between two full recomputes
+const long VAR_RECOMPUTE_INTERVAL = 1000;
+
+// Default length of a scenario step in microseconds, 0 for a round of ticks
+const long VAR_STEP_INTERVAL = 0;
+
+// Step interval that steps every product on its own ticks
+const long VAR_TICK_STEPS = -1;
+
+/**
+ * VaR service for bonds, fed by the pricing and position services.
+ * VaR and expected shortfall are reported as positive losses, 0 when the tail holds no loss.
+ */
+class BondVaRService
+{
+
+public:
+
+  // ctor for an empty book
+  BondVaRService(size_t _window = VAR_WINDOW, double _confidence = VAR_CONFIDENCE,
+                 long _recomputeInterval = VAR_RECOMPUTE_INTERVAL, ThreadPool *_pool = 0,
+                 long _stepInterval = VAR_STEP_INTERVAL);
+
+  // Record a new mid of a product
+  void AddPrice(Price<Bond> &price);
+
+  // Take the new aggregate position of a product
+  void AddPosition(Position<Bond> &position);
+
+  // Rebuild the P&L vector from the rings and positions
+  void Recompute();
+
+  // Get the value at risk of the book
+  double GetVaR();
+
+  // Get the expected shortfall of the book, the mean loss beyond VaR
+  double GetExpectedShortfall();
+
+  // Get the number of scenarios with data so far
+  size_t GetScenarioCount() const;
+
+  // Get the number of steps started so far; the current one is step GetStepCount() - 1
+  // With VAR_TICK_STEPS it is the most moves of any product
+  long GetStepCount() const;
+
+  // Get the P&L of a scenario
+  double GetScenarioPnL(size_t scenario) const;
+
+private:
+  size_t window;
+  double confidence;
+  long recomputeInterval;
+  ThreadPool *pool;
+  chrono::microseconds stepInterval;
+  unordered_map<string, size_t> index;//map from cusip to its slot
+
+  // per slot
+  vector<double> moves;//move of slot p over step n at moves[p * window + n % window]
+  vector<long> moveStep;//last step each slot moved in, -1 before its first move; its own tick with VAR_TICK_STEPS
+  vector<double> lastMid;
+  vector<long> quantity;
+
+  vector<double> pnl;//P&L of each scenario
+  long step;//current step, -1 before the first move
+  chrono::steady_clock::time_point stepStart;
+  size_t scenarios;//steps with data, up to the window
+  long updates;//updates since the last full recompute
+
+  // VaR and expected shortfall of the current P&L vector, computed when asked
+  bool stale;
+  double var;
+  double shortfall;
+  vector<double> losses;//scratch for the tail
+
+  size_t Slot(const string &cusip);
+  void Advance(long count);
+  void Updated();
+  void Measure();
+
+};
+
+BondVaRService::BondVaRService(size_t _window, double _confidence, long _recomputeInterval, ThreadPool *_pool, long _stepInterval) :
+window(_window), confidence(_confidence), recomputeInterval(_recomputeInterval), pool(_pool), stepInterval(_stepInterval),
+pnl(_window, 0), step(-1), scenarios(0), updates(0), stale(false), var(0), shortfall(0)
+{
+}
+
+size_t BondVaRService::Slot(const string &cusip)
+{
+    auto iter = index.find(cusip);
+    if (iter != index.end()) return iter->second;
+    size_t slot = lastMid.size();
+    index[cusip] = slot;
+    moves.resize(moves.size() + window, 0);
+    moveStep.push_back(-1);
+    lastMid.push_back(0);
+    quantity.push_back(0);
+    return slot;
+}
+
+//moves within a step add up to the move over the step, so one ring entry and one scenario change
+void BondVaRService::AddPrice(Price<Bond> &price)
+{
+    size_t slot = Slot(price.GetProduct().GetProductId());
+    double mid = price.GetMid();
+    if (lastMid[slot] > 0 && stepInterval.count() < 0)
+    {
+        //move k of the product replaces move k - window in its ring; nothing is cleared,
+        //since the other products still hold their own moves in that scenario
+        long tick = moveStep[slot] + 1;
+        if (tick > step)
+        {
+            step = tick;
+            scenarios = size_t(step) + 1 < window ? size_t(step) + 1 : window;
+        }
+        size_t n = tick % window;
+        double move = mid - lastMid[slot];
+        pnl[n] += quantity[slot] * (move - moves[slot * window + n]);
+        moves[slot * window + n] = move;
+        moveStep[slot] = tick;
+    }
+    else if (lastMid[slot] > 0)
+    {
+        if (step < 0)
+        {
+            Advance(1);
+            stepStart = chrono::steady_clock::now();
+        }
+        else if (stepInterval.count() > 0)
+        {
+            long elapsed = long((chrono::steady_clock::now() - stepStart) / stepInterval);
+            Advance(elapsed);
+            stepStart += elapsed * stepInterval;
+        }
+        else if (moveStep[slot] == step) Advance(1);
+        size_t n = step % window;
+        double move = mid - lastMid[slot];
+        moves[slot * window + n] += move;
+        pnl[n] += quantity[slot] * move;
+        moveStep[slot] = step;
+    }
+    lastMid[slot] = mid;
+    Updated();
+}
+
+//a new step starts with no moves, so its ring entries and its scenario are cleared
+void BondVaRService::Advance(long count)
+{
+    if (count <= 0) return;
+    long cleared = count < long(window) ? count : long(window);
+    for (long k = 0; k < cleared; ++k)
+    {
+        size_t n = (step + count - cleared + 1 + k) % window;
+        for (size_t p = 0; p < lastMid.size(); ++p) moves[p * window + n] = 0;
+        pnl[n] = 0;
+    }
+    step += count;
+    if (size_t(step) + 1 > scenarios) scenarios = size_t(step) + 1 < window ? size_t(step) + 1 : window;
+}
+
+//every scenario moves by the quantity change times the product's own move
+void BondVaRService::AddPosition(Position<Bond> &position)
+{
+    size_t slot = Slot(position.GetProduct().GetProductId());
+    long change = position.GetAggregatePosition() - quantity[slot];
+    if (change == 0) return;
+    quantity[slot] += change;
+    const double *ring = &moves[slot * window];
+    for (size_t n = 0; n < window; ++n) pnl[n] += change * ring[n];
+    Updated();
+}
+
+void BondVaRService::Updated()
+{
+    stale = true;
+    if (recomputeInterval > 0 && ++updates >= recomputeInterval) Recompute();
+}
+
+//products are summed in slot order within each scenario range, so the result does not depend on the pool
+void BondVaRService::Recompute()
+{
+    updates = 0;
+    stale = true;
+    size_t products = quantity.size();
+    auto task = [this, products](size_t begin, size_t end)
+    {
+        double *__restrict__ total = &pnl[0];
+        for (size_t n = begin; n < end; ++n) total[n] = 0;
+        for (size_t p = 0; p < products; ++p)
+        {
+            if (!quantity[p]) continue;
+            double q = double(quantity[p]);
+            const double *__restrict__ ring = &moves[p * window];
+            for (size_t n = begin; n < end; ++n) total[n] += q * ring[n];
+        }
+    };
+    if (pool) pool->ParallelFor(window, 64, task);
+    else task(0, window);
+}
+
+//the worst (1 - confidence) of the scenarios form the tail
+void BondVaRService::Measure()
+{
+    stale = false;
+    var = 0;
+    shortfall = 0;
+    if (!scenarios) return;
+    losses.resize(scenarios);
+    for (size_t n = 0; n < scenarios; ++n) losses[n] = -pnl[n];
+    size_t tail = size_t((1 - confidence) * scenarios);
+    if (tail == 0) tail = 1;
+    nth_element(losses.begin(), losses.begin() + (tail - 1), losses.end(), greater<double>());
+    var = losses[tail - 1];
+    double sum = 0;
+    for (size_t n = 0; n < tail; ++n) sum += losses[n];
+    shortfall = sum / tail;
+    //a tail of gains is no loss
+    if (var < 0) var = 0;
+    if (shortfall < 0) shortfall = 0;
+}
+
+double BondVaRService::GetVaR()
+{
+    if (stale) Measure();
+    return var;
+}
+
+double BondVaRService::GetExpectedShortfall()
+{
+    if (stale) Measure();
+    return shortfall;
+}
+
+size_t BondVaRService::GetScenarioCount() const
+{
+    return scenarios;
+}
+
+long BondVaRService::GetStepCount() const
+{
+    return step + 1;
+}
+
+double BondVaRService::GetScenarioPnL(size_t scenario) const
+{
+    return pnl[scenario];
+}
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * yieldservice.hpp
+ * Yields to maturity of the bid, mid and offer of every product.
+ *
+ * Prices come from the pricing service; bid and offer are the mid less and plus half the
+ * spread, as streamed. A tick only stores the new dirty prices of its product. The yields
+ * of the whole universe are solved together when they are next read, one batched Newton
+ * solve per side over the schedules of the shared analytics, starting from the yields
+ * of the previous solve, so products that did not move converge at once.
+ */
+#ifndef YIELD_SERVICE_HPP
+#define YIELD_SERVICE_HPP
+
+#include <vector>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+#include "bondanalytics.hpp"
+
+using namespace std;
+
+// Sides a yield is quoted on
+enum YieldSide { BID_YIELD, MID_YIELD, OFFER_YIELD };
+const int YIELD_SIDE_COUNT = 3;
+
+/**
+ * Bond yield service, listening to the pricing service.
+ * Products are addressed by their slot in the analytics.
+ */
+class BondYieldService : public ServiceListener<Price<Bond>>
+{
+
+public:
+
+  // ctor for a service solving over the schedules of analytics
+  BondYieldService(BondAnalytics &_analytics);
+
+  // Take a new price from the pricing service
+  void ProcessAdd(Price<Bond> &price);
+  void ProcessRemove(Price<Bond> &price) {}
+  void ProcessUpdate(Price<Bond> &price) {}
+
+  // Solve the yields of every product priced since the last solve
+  void Refresh();
+
+  // Get the yield of a product on a side, or 0 for a product the analytics does not know
+  double GetYield(const string &cusip, YieldSide side);
+
+  // Get the yields of all products on a side, in analytics slot order
+  // Valid until the next price arrives
+  const vector<double>& GetYields(YieldSide side);
+
+  // Get the number of batched solves run so far
+  long GetSolveCount() const;
+
+private:
+  BondAnalytics &analytics;
+  vector<double> targets[YIELD_SIDE_COUNT];//dirty price of each slot on each side
+  vector<double> yields[YIELD_SIDE_COUNT];//yield of each slot on each side, the warm start of the next solve
+  YieldWorkspace work;
+  bool stale;//has a price arrived since the last solve?
+  long solves;
+
+  void Track();
+
+};
+
+BondYieldService::BondYieldService(BondAnalytics &_analytics) : analytics(_analytics), stale(false), solves(0)
+{
+}
+
+//products the analytics knows but that were never priced here stay at their analytics price
+void BondYieldService::Track()
+{
+    for (size_t p = yields[MID_YIELD].size(); p < analytics.Size(); ++p)
+    {
+        double dirty = analytics.GetPrice(p) + analytics.GetAccrued(p);
+        for (int side = 0; side < YIELD_SIDE_COUNT; ++side)
+        {
+            targets[side].push_back(dirty);
+            yields[side].push_back(analytics.GetYield(p));
+        }
+    }
+}
+
+void BondYieldService::ProcessAdd(Price<Bond> &price)
+{
+    size_t slot = analytics.AddBond(price.GetProduct());
+    if (slot >= yields[MID_YIELD].size()) Track();
+    double dirty = price.GetMid() + analytics.GetAccrued(slot);
+    double half_spread = price.GetBidOfferSpread() / 2;
+    targets[BID_YIELD][slot] = dirty - half_spread;
+    targets[MID_YIELD][slot] = dirty;
+    targets[OFFER_YIELD][slot] = dirty + half_spread;
+    stale = true;
+}
+
+void BondYieldService::Refresh()
+{
+    if (analytics.Size() > yields[MID_YIELD].size()) Track();
+    if (!stale) return;
+    for (int side = 0; side < YIELD_SIDE_COUNT; ++side)
+        analytics.SolveYields(targets[side].data(), yields[side].data(), work);
+    stale = false;
+    ++solves;
+}
+
+double BondYieldService::GetYield(const string &cusip, YieldSide side)
+{
+    long slot = analytics.FindBond(cusip);
+    if (slot < 0) return 0;
+    Refresh();
+    return yields[side][slot];
+}
+
+const vector<double>& BondYieldService::GetYields(YieldSide side)
+{
+    Refresh();
+    return yields[side];
+}
+
+long BondYieldService::GetSolveCount() const
+{
+    return solves;
+}
+
+#endif